@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Sorted id list with an optional bloom filter in front of it,
+// most lookups of ids absent from the list never reach the binary search.
+class SimpleTgIdSet {
+    static constexpr std::size_t BloomBitsPerId = 10;
+    static constexpr std::size_t BloomHashes = 4;
+
+    std::vector<std::int64_t> m_Ids;
+    std::vector<std::uint64_t> m_Bloom;
+    std::uint64_t m_BloomMask = 0;
+public:
+    SimpleTgIdSet() = default;
+
+    SimpleTgIdSet(std::vector<std::int64_t> ids, bool use_bloom);
+
+    bool Contains(std::int64_t id)const;
+
+    bool IsEmpty()const {
+        return m_Ids.empty();
+    }
+
+    std::size_t Size()const {
+        return m_Ids.size();
+    }
+private:
+    bool MayContain(std::int64_t id)const;
+
+    static std::uint64_t Hash(std::int64_t id);
+};
+
+// Immutable access rules, deny lists win over allow lists.
+// When both allow lists are empty everybody who is not denied passes.
+// Chat id 0 means the chat is unknown: inline queries and callbacks from inline messages carry no chat,
+// so only user rules apply to them and a user allowed only through AllowedChats does not pass
+struct SimpleTgAclRules {
+    SimpleTgIdSet AllowedUsers;
+    SimpleTgIdSet AllowedChats;
+    SimpleTgIdSet DeniedUsers;
+    SimpleTgIdSet DeniedChats;
+
+    bool IsLegit(std::int64_t chat_id, std::int64_t user_id)const;
+};
+
+// Access control engine behind SimpleTgBot::IsLegit. Rules are rebuilt aside and swapped in atomically,
+// so checks running on other threads keep using the old snapshot and never wait for a reload.
+// Every thread caches a weak reference to the snapshot it used last, a check is a load of the generation
+// and a lock of that reference unless a reload happened since, only then the mutex is taken to pick up
+// the new snapshot. Weak, so threads don't keep replaced rules or rules of destroyed acls alive
+class SimpleTgAcl {
+public:
+    struct Builder {
+        std::vector<std::int64_t> AllowedUsers;
+        std::vector<std::int64_t> AllowedChats;
+        std::vector<std::int64_t> DeniedUsers;
+        std::vector<std::int64_t> DeniedChats;
+        bool UseBloomFilter = true;
+
+        std::shared_ptr<const SimpleTgAclRules> Build();
+    };
+private:
+    struct LocalSnapshot {
+        std::uint64_t AclId;
+        std::uint64_t Generation;
+        std::weak_ptr<const SimpleTgAclRules> Rules;
+    };
+
+    const std::uint64_t m_Id;
+
+    mutable std::mutex m_Lock;
+    std::shared_ptr<const SimpleTgAclRules> m_Rules;
+    std::atomic<std::uint64_t> m_Generation{1};
+public:
+    SimpleTgAcl();
+
+    SimpleTgAcl(const SimpleTgAcl &) = delete;
+
+    SimpleTgAcl &operator=(const SimpleTgAcl &) = delete;
+
+    bool IsLegit(std::int64_t chat_id, std::int64_t user_id)const;
+
+    void Reload(Builder &&builder);
+
+    void Reload(std::shared_ptr<const SimpleTgAclRules> rules);
+
+    // Text file, one rule per line: 'allow_user <id>', 'allow_chat <id>', 'deny_user <id>', 'deny_chat <id>', '#' starts a comment
+    bool ReloadFromFile(const std::string &path, bool use_bloom = true);
+
+    std::shared_ptr<const SimpleTgAclRules> Rules()const;
+
+    static bool ParseRules(const std::string &content, Builder &builder);
+private:
+    std::shared_ptr<const SimpleTgAclRules> LocalRules()const;
+};
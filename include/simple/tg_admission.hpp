@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <tgbot/Bot.h>
+
+struct SimpleTgAdmissionLimits {
+    // Tokens per second and bucket size, every update of a user or chat takes one token
+    double UserRate = 1.0;
+    double UserBurst = 10.0;
+    double ChatRate = 20.0;
+    double ChatBurst = 60.0;
+    // Presses of the same button on the same message by the same user within the window count once
+    std::chrono::steady_clock::duration DuplicateWindow = std::chrono::seconds(2);
+    // Once the newest message of a batch is older than LagThreshold, messages older than StaleAge are dropped
+    std::chrono::seconds LagThreshold{10};
+    std::chrono::seconds StaleAge{60};
+    std::chrono::steady_clock::duration ReportInterval = std::chrono::seconds(10);
+};
+
+// Admission stage in front of update dispatch: filters a batch of updates in place and puts callback and inline queries
+// first, since those have a response deadline. Membership updates are never dropped.
+// Dropped callback queries are not answered, answering them would cost the api calls flood control saves
+class SimpleTgAdmission {
+    struct Bucket {
+        double Tokens;
+        std::chrono::steady_clock::time_point Updated;
+    };
+
+    SimpleTgAdmissionLimits m_Limits;
+
+    std::mutex m_Lock;
+    std::unordered_map<std::int64_t, Bucket> m_UserBuckets;
+    std::unordered_map<std::int64_t, Bucket> m_ChatBuckets;
+    std::unordered_map<std::uint64_t, std::chrono::steady_clock::time_point> m_RecentPresses;
+
+    std::size_t m_ShedStale = 0;
+    std::size_t m_ShedRateLimited = 0;
+    std::size_t m_ShedDuplicates = 0;
+    std::chrono::seconds m_PeakLag{0};
+    std::chrono::steady_clock::time_point m_LastReport = std::chrono::steady_clock::now();
+public:
+    SimpleTgAdmission(SimpleTgAdmissionLimits limits = {});
+
+    SimpleTgAdmission(const SimpleTgAdmission &) = delete;
+
+    SimpleTgAdmission &operator=(const SimpleTgAdmission &) = delete;
+
+    // Lag is measured on the batch itself, age of its newest message tells how far behind the bot is
+    void Admit(std::vector<TgBot::Update::Ptr> &updates);
+
+    // Shed counts since the previous report, at most once per ReportInterval and only if something was shed
+    std::optional<std::string> TakeReport();
+private:
+    static Bucket &Refill(std::unordered_map<std::int64_t, Bucket> &buckets, std::int64_t id, double rate, double burst, std::chrono::steady_clock::time_point now);
+
+    bool IsDuplicatePress(const TgBot::CallbackQuery &query, std::chrono::steady_clock::time_point now);
+
+    template<typename KeyType, typename ValueType, typename PredicateType>
+    static void Prune(std::unordered_map<KeyType, ValueType> &map, const PredicateType &expired);
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <tgbot/Bot.h>
+#include <future>
 #include <map>
 #include <string>
 #include <vector>
@@ -9,12 +10,14 @@ class SimpleTgBackup {
 private:
     std::int64_t m_BackupChatId;
     TgBot::Bot m_Bot;
-    TgBot::Chat::Ptr m_BackupChat;
+    // getChat runs in background, constructor does not wait for the network
+    std::shared_future<TgBot::Chat::Ptr> m_BackupChat;
     std::string m_BotName;
     std::string m_ApplicationName;
 public:
     SimpleTgBackup(const std::string &token, std::int64_t backup_chat, const std::string &bot_name, const std::string &application_name);
 
+    // Waits for the chat lookup started by constructor
     bool IsValid() const;
 
     bool Backup(const std::map<std::string, std::string> &files);
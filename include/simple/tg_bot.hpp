@@ -1,12 +1,29 @@
 #pragma once
 
 #include <functional>
+#include <list>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <optional>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <atomic>
 #include <bsl/format.hpp>
+#include <boost/asio/thread_pool.hpp>
 #include <tgbot/Bot.h>
 #include <tgbot/net/TgLongPoll.h>
+#include "simple/tg_metrics.hpp"
+#include "simple/tg_trace.hpp"
+#include "simple/tg_acl.hpp"
+#include "simple/tg_checkpoint.hpp"
+#include "simple/tg_timer.hpp"
+#include "simple/tg_upload_cache.hpp"
+#include "simple/tg_inline.hpp"
+#include "simple/tg_html.hpp"
+#include "simple/tg_admission.hpp"
 
 #undef SendMessage
 
@@ -76,6 +93,72 @@ namespace Keyboard {
     std::vector<KeyboardButton> ToKeyboardRow(const std::vector<std::string> &texts);
 }
 
+// Keyboard over a large indexed source that builds buttons of the visible page only.
+// Navigation buttons carry "<id>|<page in base 36>" as callback data, so id should be short and unique per keyboard
+class PaginatedKeyboard {
+public:
+    // Called only for entries on the requested page
+    using ButtonBuilder = std::function<KeyboardButton(std::size_t index)>;
+private:
+    static constexpr std::size_t MaxCachedPages = 16;
+
+    std::string m_Id;
+    ButtonBuilder m_Builder;
+    std::size_t m_RowSize;
+    std::size_t m_PageSize;
+
+    mutable std::mutex m_Lock;
+    std::size_t m_Size;
+    // Bumped by Reset, so a page built from the old source is not cached
+    std::size_t m_Generation = 0;
+    // Most recently shown first
+    mutable std::list<std::pair<std::size_t, KeyboardLayout>> m_CachedPages;
+    mutable std::unordered_map<std::size_t, std::list<std::pair<std::size_t, KeyboardLayout>>::iterator> m_PageIndex;
+public:
+    PaginatedKeyboard(std::string id, std::size_t size, ButtonBuilder builder, std::size_t row_size = 1, std::size_t rows_per_page = 8);
+
+    // Entries are shared, not copied. T is deduced from entries only, so lambdas can be passed as is
+    template<typename T>
+    PaginatedKeyboard(std::string id, std::shared_ptr<const std::vector<T>> entries, std::size_t row_size, std::size_t rows_per_page, std::function<std::string(const typename std::vector<T>::value_type &)> make_text, std::function<std::string(const typename std::vector<T>::value_type &)> make_key):
+        PaginatedKeyboard(std::move(id), entries->size(), [entries, make_text, make_key](std::size_t index) {
+            const T &entry = (*entries)[index];
+            return KeyboardButton(make_text(entry), make_key(entry));
+        }, row_size, rows_per_page)
+    {}
+
+    const std::string &Id()const { return m_Id; }
+
+    std::size_t Size()const;
+
+    std::size_t PagesCount()const;
+
+    // Out of range page is clamped to the last one. Builder runs outside the lock, on a cache miss only
+    KeyboardLayout Page(std::size_t page)const;
+
+    // Page a navigation button of this keyboard points to, empty for any other callback data and page counter
+    std::optional<std::size_t> ParsePage(const std::string &callback_data)const;
+
+    // Source changed, cached pages are dropped
+    void Reset(std::size_t size);
+
+    std::string PageCallbackData(std::size_t page)const;
+private:
+    std::size_t PagesCount(std::size_t size)const;
+};
+
+struct MediaGroupItem {
+    TgBot::InputFile::Ptr File;
+    std::string Caption;
+    // Telegram groups documents only with documents, mixed sets are split into runs of the same kind
+    bool Document = false;
+
+    MediaGroupItem(TgBot::InputFile::Ptr file, std::string caption = "", bool document = false) :
+        File(std::move(file)),
+        Caption(std::move(caption)),
+        Document(document)
+    {}
+};
+
 class SimpleTgBot: public TgBot::Bot{
     static constexpr const char *ParseMode = "HTML";
     static constexpr bool DisableWebpagePreview = true;
@@ -86,22 +169,132 @@ public:
     using MessageHandler = std::function<void(TgBot::Message::Ptr)>;
     using CallbackQueryHandler = std::function<void(TgBot::CallbackQuery::Ptr)>;
     using ChatMemberStatusHandler = std::function<void(TgBot::ChatMemberUpdated::Ptr)>;
+    using InlineQueryHandler = std::function<InlineQueryAnswer(TgBot::InlineQuery::Ptr)>;
+
+    // One shot waiters, called with nullptr on timeout (from a worker thread) or when replaced by a newer wait
+    using MessageWaiter = std::function<void(TgBot::Message::Ptr)>;
+    using CallbackQueryWaiter = std::function<void(TgBot::CallbackQuery::Ptr)>;
+
+    static constexpr std::chrono::minutes DefaultWaitTimeout{10};
+    static constexpr std::chrono::milliseconds DefaultInlineQueryDebounce{300};
+    // Most updates a single getUpdates may return
+    static constexpr std::int32_t MaxUpdatesLimit = 100;
+    static constexpr const char *DefaultApiUrl = "https://api.telegram.org";
+
+    // Awaitables for SimpleTgConversation coroutines, see simple/tg_conversation.hpp
+    struct MessageAwaiter {
+        SimpleTgBot *Bot;
+        std::int64_t Chat;
+        std::int64_t User;
+        std::chrono::steady_clock::duration Timeout;
+        TgBot::Message::Ptr Result;
+
+        bool await_ready()const { return false; }
+
+        template<typename HandleType>
+        void await_suspend(HandleType handle) {
+            Bot->WaitMessage(Chat, User, Timeout, [this, handle](TgBot::Message::Ptr message) {
+                Result = std::move(message);
+                handle.resume();
+            });
+        }
+
+        TgBot::Message::Ptr await_resume() { return std::move(Result); }
+    };
+
+    struct CallbackQueryAwaiter {
+        SimpleTgBot *Bot;
+        std::int64_t Chat;
+        std::int32_t Message;
+        std::chrono::steady_clock::duration Timeout;
+        TgBot::CallbackQuery::Ptr Result;
+        std::int64_t User = 0;
+
+        bool await_ready()const { return false; }
+
+        template<typename HandleType>
+        void await_suspend(HandleType handle) {
+            Bot->WaitCallbackQuery(Chat, Message, Timeout, [this, handle](TgBot::CallbackQuery::Ptr query) {
+                Result = std::move(query);
+                handle.resume();
+            }, User);
+        }
+
+        TgBot::CallbackQuery::Ptr await_resume() { return std::move(Result); }
+    };
 private:
+    template<typename WaiterType>
+    struct Wait {
+        std::chrono::steady_clock::time_point Deadline;
+        SimpleTgTimerWheel::TimerId Timer = 0;
+        WaiterType Waiter;
+        // Callback waits only, 0 lets any legit member of the chat press
+        std::int64_t User = 0;
+    };
+
     LogHandler m_Log;
 
+    const std::string m_ApiUrl;
+    // Parsed once, raw requests reuse them
+    const TgBot::Url m_SendMessageUrl;
+    const TgBot::Url m_SendMediaGroupUrl;
+
+    SimpleTgMetrics *m_Metrics = nullptr;
+    SimpleTgTracer *m_Tracer = nullptr;
+    SimpleTgOffsetCheckpoint *m_Checkpoint = nullptr;
+    bool m_CatchUp = true;
+    const SimpleTgAcl *m_Acl = nullptr;
+    SimpleTgUploadCache *m_UploadCache = nullptr;
+    SimpleTgAdmission *m_Admission = nullptr;
+
     std::unordered_map<std::string, CommandHandler> m_CommandHandlers;
     std::unordered_map<std::string, std::string> m_CommandDescriptions;
 
-    std::string m_Username;
+    struct Identity {
+        std::string Username;
+        std::string Error;
+    };
+
+    // getMe runs in background, constructor does not wait for the network
+    std::shared_future<Identity> m_Identity;
+    std::atomic<bool> m_IdentityErrorReported{false};
+
+    std::mutex m_WaitsLock;
+    std::map<std::pair<std::int64_t, std::int64_t>, Wait<MessageWaiter>> m_MessageWaits;
+    std::map<std::pair<std::int64_t, std::int32_t>, Wait<CallbackQueryWaiter>> m_CallbackQueryWaits;
+    // Weak, so a new update allocated where a consumed one was freed is not taken for it
+    std::weak_ptr<const void> m_ConsumedUpdate;
+
+    struct PendingInlineQuery {
+        TgBot::InlineQuery::Ptr Query;
+        SimpleTgTimerWheel::TimerId Timer = 0;
+    };
+
+    InlineQueryHandler m_InlineQueryHandler;
+    std::chrono::steady_clock::duration m_InlineQueryDebounce = DefaultInlineQueryDebounce;
+    SimpleTgInlineResultCache m_InlineResults;
+    std::mutex m_InlineQueriesLock;
+    std::unordered_map<std::int64_t, PendingInlineQuery> m_PendingInlineQueries;
+    // Timers only hand work over to these: expired waits resume conversations and debounced inline queries
+    // call the backend, neither may hold up other timers
+    boost::asio::thread_pool m_Workers{2};
+
+    // Declared last, so timer thread is stopped before anything its callbacks touch is gone
+    SimpleTgTimerWheel m_Timers;
 public:
-    SimpleTgBot(const std::string &token, const TgBot::HttpClient &client = GetDefaultHttpClient());
+    // Url is the Bot API server, e.g. a local one, both tgbot's api and raw requests go there
+    SimpleTgBot(const std::string &token, const TgBot::HttpClient &client = GetDefaultHttpClient(), const std::string &url = DefaultApiUrl);
 
     void LongPoll(std::int32_t limit = 100, std::int32_t timeout = 10, std::vector<std::string> &&allowed_updates = {});
 
     virtual void OnLongPollIteration();
 
+    // Default implementation consults acl if any was set and lets everyone in otherwise.
+    // Chat id is 0 for inline queries and callbacks from inline messages, they have no chat
     virtual bool IsLegit(std::int64_t chat_id, std::int64_t user_id) const;
 
+    void SetAcl(const SimpleTgAcl *acl);
+
     void OnLog(LogHandler handler);
 
     template<typename Type>
@@ -112,25 +305,71 @@ public:
     template<typename ...ArgsType>
 	void Log(const char* fmt, const ArgsType&...args);
 
+    // Metrics are not owned, to measure api calls pass SimpleTgMetricsHttpClient to constructor
+    void SetMetrics(SimpleTgMetrics *metrics);
+
+    SimpleTgMetrics *GetMetrics()const;
+
+    // Tracer is not owned, to trace api calls pass SimpleTgTracingHttpClient to constructor
+    void SetTracer(SimpleTgTracer *tracer);
+
+    SimpleTgTracer *GetTracer()const;
+
+    // Cache is not owned and may be shared between bots, keys include the bot id.
+    // SendPhoto/SendFile send cached file_id instead of uploading the same content again
+    void SetUploadCache(SimpleTgUploadCache *cache);
+
+    SimpleTgUploadCache *GetUploadCache()const;
+
+    // Admission is not owned. LongPoll and the host filter each batch through it before dispatch and log shed counts
+    void SetAdmission(SimpleTgAdmission *admission);
+
+    SimpleTgAdmission *GetAdmission()const;
+
+    // Checkpoint is not owned. LongPoll resumes from its offset and, with catch_up, drains the backlog
+    // in batches of MaxUpdatesLimit committed once per batch, until a partial batch shows it is drained
+    void SetCheckpoint(SimpleTgOffsetCheckpoint *checkpoint, bool catch_up = true);
+
+    SimpleTgOffsetCheckpoint *GetCheckpoint()const;
+
+    bool IsCatchUpEnabled()const;
+
+    const std::string &GetApiUrl()const;
+
+    // Does nothing when checkpoint holds an offset, queued updates are handled instead of being dropped
     void ClearOldUpdates();
 
+    // Waits for the identity lookup started by constructor, empty if it failed
+    const std::string &GetUsername();
+
     bool SendChatAction(TgBot::Message::Ptr source, const std::string &action);
 
     TgBot::Message::Ptr SendMessage(std::int64_t chat, std::int32_t topic, const std::string& message, std::int64_t reply_message = 0, bool silent = false);
 
     TgBot::Message::Ptr SendMessage(TgBot::Message::Ptr source, const std::string& message, bool reply = false, bool silent = false);
+
+    // Html over the message limit goes out as several messages, see SimpleTgHtmlBuilder::SplitMessage, only first one replies
+    std::vector<TgBot::Message::Ptr> SendLongMessage(std::int64_t chat, std::int32_t topic, const std::string& html, std::int64_t reply_message = 0, bool silent = false);
     
     TgBot::Message::Ptr ReplyMessage(TgBot::Message::Ptr source, const std::string& message, bool silent = false){return SendMessage(source, message, true, silent); }
 
     //source->isTopicMessage ? source->messageThreadId : 0
     TgBot::Message::Ptr SendMessage(std::int64_t chat, std::int32_t topic, const std::string& message, TgBot::GenericReply::Ptr reply, std::int64_t reply_message = 0, bool silent = false);
 
+    // Text is moved into the request instead of being copied
+    TgBot::Message::Ptr SendMessage(std::int64_t chat, std::int32_t topic, std::string&& message, TgBot::GenericReply::Ptr reply = nullptr, std::int64_t reply_message = 0, bool silent = false);
+
     TgBot::Message::Ptr SendKeyboard(std::int64_t chat, std::int32_t topic, const std::string& message, const KeyboardLayout& keyboard, std::int64_t reply_message = 0);
 
     TgBot::Message::Ptr SendKeyboard(TgBot::Message::Ptr source, const std::string& message, const KeyboardLayout &keyboard, bool reply = false){return SendKeyboard(source->chat->id, source->isTopicMessage ? source->messageThreadId : 0, message, keyboard, reply ? source->messageId : 0); }
 
     TgBot::Message::Ptr ReplyKeyboard(TgBot::Message::Ptr source, const std::string& message, const KeyboardLayout &keyboard){return SendKeyboard(source, message, keyboard, true);}
 
+    TgBot::Message::Ptr SendKeyboard(std::int64_t chat, std::int32_t topic, const std::string& message, const PaginatedKeyboard& keyboard, std::size_t page = 0, std::int64_t reply_message = 0);
+
+    // Call from OnCallbackQuery handler, true when query was a page flip of keyboard and is handled
+    bool HandlePageFlip(TgBot::CallbackQuery::Ptr query, const PaginatedKeyboard& keyboard);
+
     TgBot::Message::Ptr SendPhoto(std::int64_t chat, std::int32_t topic, const std::string& text, TgBot::InputFile::Ptr photo, std::int64_t reply_message = 0);
 
     TgBot::Message::Ptr SendPhoto(TgBot::Message::Ptr source, const std::string& text, TgBot::InputFile::Ptr photo);
@@ -143,6 +382,14 @@ public:
 
     TgBot::Message::Ptr ReplyFile(TgBot::Message::Ptr source, const std::string& text, TgBot::InputFile::Ptr photo);
 
+    // Sends up to 10 items per sendMediaGroup call, bigger sets are chunked, next chunk is prepared while previous one uploads
+    // Nothing is sent and result is empty if any item has no file
+    std::vector<TgBot::Message::Ptr> SendMediaGroup(std::int64_t chat, std::int32_t topic, const std::vector<MediaGroupItem>& media, std::int64_t reply_message = 0);
+
+    std::vector<TgBot::Message::Ptr> SendMediaGroup(TgBot::Message::Ptr source, const std::vector<MediaGroupItem>& media);
+
+    std::vector<TgBot::Message::Ptr> ReplyMediaGroup(TgBot::Message::Ptr source, const std::vector<MediaGroupItem>& media);
+
     TgBot::Message::Ptr EditMessage(TgBot::Message::Ptr message, const std::string& text, TgBot::InlineKeyboardMarkup::Ptr reply);
 
     TgBot::Message::Ptr EditMessage(TgBot::Message::Ptr message, const std::string& text, const KeyboardLayout& keyboard);
@@ -167,6 +414,28 @@ public:
 
     bool AnswerCallbackQuery(const std::string& callbackQueryId, const std::string& text = "");
 
+    // Next non-command message from user in chat goes to the waiter instead of OnNonCommandMessage handlers
+    void WaitMessage(std::int64_t chat, std::int64_t user, std::chrono::steady_clock::duration timeout, MessageWaiter waiter);
+
+    // Next callback query on the message goes to the waiter instead of OnCallbackQuery handlers.
+    // With user set, presses of anybody else go to the handlers as usual
+    void WaitCallbackQuery(std::int64_t chat, std::int32_t message, std::chrono::steady_clock::duration timeout, CallbackQueryWaiter waiter, std::int64_t user = 0);
+
+    MessageAwaiter NextMessage(std::int64_t chat, std::int64_t user, std::chrono::steady_clock::duration timeout = DefaultWaitTimeout);
+
+    MessageAwaiter NextMessage(TgBot::Message::Ptr source, std::chrono::steady_clock::duration timeout = DefaultWaitTimeout);
+
+    CallbackQueryAwaiter NextCallback(TgBot::Message::Ptr message, std::chrono::steady_clock::duration timeout = DefaultWaitTimeout, std::int64_t user = 0);
+
+    std::size_t WaitsCount();
+
+    // Callback runs on the timer thread as soon as it is due, exceptions are logged
+    SimpleTgTimerWheel::TimerId ScheduleAfter(std::chrono::steady_clock::duration delay, std::function<void()> callback);
+
+    SimpleTgTimerWheel::TimerId ScheduleAt(std::chrono::steady_clock::time_point time, std::function<void()> callback);
+
+    bool CancelTimer(SimpleTgTimerWheel::TimerId timer);
+
     void OnCommand(const std::string &command, CommandHandler handler, std::string &&description = "");
     
     template<typename Type>
@@ -186,6 +455,16 @@ public:
 
     void OnMyChatMember(ChatMemberStatusHandler chat_member);
 
+    // Single handler, its answer answers the query. A query waits debounce and is dropped if the same user types
+    // a newer one meanwhile, then runs on a worker thread, zero debounce runs handler right away on the poll thread.
+    // Answers are cached by normalized query text and offset for their CacheTime, cache hits are answered without calling the handler
+    void OnInlineQuery(InlineQueryHandler handler, std::chrono::steady_clock::duration debounce = DefaultInlineQueryDebounce, std::size_t cache_capacity = 1024);
+
+    template<typename Type>
+    void OnInlineQuery(Type *object, InlineQueryAnswer (Type::*handler)(TgBot::InlineQuery::Ptr));
+
+    SimpleTgInlineResultCache &GetInlineResultCache();
+
     template<typename Type>
     void OnMyChatMember(Type *object, void (Type::*handler)(TgBot::ChatMemberUpdated::Ptr));
 
@@ -207,6 +486,38 @@ public:
     static std::string GetTextWithoutCommand(const std::string &text);
 
     static const TgBot::HttpClient &GetDefaultHttpClient();
+
+    // 0 when the update has no chat
+    static std::int64_t GetUpdateChatId(const TgBot::Update::Ptr &update);
+
+    // Unix time Telegram got the update at, 0 for updates without a date such as callback queries
+    static std::uint32_t GetUpdateDate(const TgBot::Update::Ptr &update);
+private:
+    template<typename HandlerType, typename ArgType>
+    void RunHandler(std::string_view name, std::int64_t chat_id, const HandlerType &handler, const ArgType &arg);
+
+    bool ResumeMessageWait(TgBot::Message::Ptr message);
+
+    bool ResumeCallbackQueryWait(TgBot::CallbackQuery::Ptr query);
+
+    bool IsConsumed(const std::shared_ptr<const void> &update)const;
+
+    using MediaSender = std::function<TgBot::Message::Ptr(const boost::variant<TgBot::InputFile::Ptr, std::string> &)>;
+
+    TgBot::Message::Ptr SendMedia(TgBot::InputFile::Ptr file, const char *kind, const MediaSender &send);
+
+    // Returns "result" of the response, throws TgBot::TgException with Telegram's description when it is not ok
+    boost::property_tree::ptree SendRequest(const TgBot::Url &url, const std::vector<TgBot::HttpReqArg> &args)const;
+
+    void HandleInlineQuery(TgBot::InlineQuery::Ptr query);
+
+    void RunInlineQuery(std::int64_t user);
+
+    void AnswerInlineQuery(TgBot::InlineQuery::Ptr query, const InlineQueryAnswer &answer);
+
+    void ExpireMessageWait(std::pair<std::int64_t, std::int64_t> key);
+
+    void ExpireCallbackQueryWait(std::pair<std::int64_t, std::int32_t> key);
 };
 
 template<typename Type>
@@ -219,6 +530,26 @@ void SimpleTgBot::Log(const char* fmt, const ArgsType&...args) {
 	Log(Format(fmt, args...));
 }
 
+template<typename HandlerType, typename ArgType>
+void SimpleTgBot::RunHandler(std::string_view name, std::int64_t chat_id, const HandlerType &handler, const ArgType &arg) {
+    SimpleTgTracer::HandlerScope scope(m_Tracer, name, chat_id);
+
+    if(!m_Metrics)
+        return handler(arg);
+
+    const std::string series(name);
+    const auto start = std::chrono::steady_clock::now();
+
+    try {
+        handler(arg);
+    } catch (...) {
+        m_Metrics->RecordHandler(series, std::chrono::steady_clock::now() - start, true);
+        throw;
+    }
+
+    m_Metrics->RecordHandler(series, std::chrono::steady_clock::now() - start, false);
+}
+
 template<typename Type>
 void SimpleTgBot::OnCommand(const std::string& command, Type *object, void (Type::* handler)(TgBot::Message::Ptr), std::string &&description) {
     OnCommand(command, std::bind(handler, object, std::placeholders::_1), std::move(description));
@@ -239,6 +570,11 @@ void SimpleTgBot::OnMyChatMember(Type* object, void (Type::* handler)(TgBot::Cha
     OnMyChatMember(std::bind(handler, object, std::placeholders::_1));
 }
 
+template<typename Type>
+void SimpleTgBot::OnInlineQuery(Type* object, InlineQueryAnswer (Type::* handler)(TgBot::InlineQuery::Ptr)) {
+    OnInlineQuery(std::bind(handler, object, std::placeholders::_1));
+}
+
 template<typename Type>
 void SimpleTgBot::OnOtherChatMember(Type* object, void (Type::* handler)(TgBot::ChatMemberUpdated::Ptr)) {
     OnOtherChatMember(std::bind(handler, object, std::placeholders::_1));
@@ -255,11 +591,21 @@ public:
 
 class FastLongPoll {
 public:
-    FastLongPoll(const TgBot::Api* api, const TgBot::EventHandler* eventHandler, std::int32_t limit, std::int32_t timeout, std::shared_ptr<std::vector<std::string>> allowUpdates);
-    FastLongPoll(const TgBot::Bot& bot, std::int32_t limit = 100, std::int32_t timeout = 10, const std::shared_ptr<std::vector<std::string>>& allowUpdates = nullptr);
+    FastLongPoll(const TgBot::Api* api, const TgBot::EventHandler* eventHandler, std::int32_t limit, std::int32_t timeout, std::shared_ptr<std::vector<std::string>> allowUpdates, bool skipPendingUpdates = true);
+    FastLongPoll(const TgBot::Bot& bot, std::int32_t limit = 100, std::int32_t timeout = 10, const std::shared_ptr<std::vector<std::string>>& allowUpdates = nullptr, bool skipPendingUpdates = true);
 
     void start();
 
+    void setMetrics(SimpleTgMetrics* metrics);
+
+    void setTracer(SimpleTgTracer* tracer);
+
+    // Construct with skipPendingUpdates = false, otherwise the backlog is confirmed before checkpoint is read
+    void setCheckpoint(SimpleTgOffsetCheckpoint* checkpoint, bool catchUp = true);
+
+    // Shed updates are confirmed like handled ones, reports go to log
+    void setAdmission(SimpleTgAdmission* admission, std::function<void(const std::string&)> log = nullptr);
+
 private:
 
     void handleUpdates();
@@ -271,6 +617,16 @@ private:
     std::int32_t _limit;
     std::int32_t _timeout;
     std::shared_ptr<std::vector<std::string>> _allowUpdates;
+    SimpleTgMetrics* _metrics = nullptr;
+    SimpleTgTracer* _tracer = nullptr;
+    SimpleTgOffsetCheckpoint* _checkpoint = nullptr;
+    bool _catchingUp = false;
+    // Set for batches received while catching up, their offset is committed once after the batch
+    bool _commitPerBatch = false;
+    SimpleTgAdmission* _admission = nullptr;
+    std::function<void(const std::string&)> _log;
+    // Ids past a rolled back offset that were already dispatched or shed, skipped when fetched again
+    std::unordered_set<std::int32_t> _redelivered;
 
     std::vector<TgBot::Update::Ptr> _updates;
 };
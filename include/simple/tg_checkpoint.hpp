@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+
+// Persists the getUpdates offset of the last handled update, so a restarted bot continues where it stopped
+// instead of dropping or blindly replaying queued updates. Writes go through a synced temporary file and rename,
+// and are batched: file is rewritten every batch_size commits or once per interval, whatever comes first.
+class SimpleTgOffsetCheckpoint {
+    std::string m_Path;
+    std::size_t m_BatchSize;
+    std::chrono::steady_clock::duration m_Interval;
+
+    mutable std::mutex m_Lock;
+    std::optional<std::int32_t> m_Offset;
+    std::int32_t m_WrittenOffset = 0;
+    std::size_t m_PendingCommits = 0;
+    std::chrono::steady_clock::time_point m_LastWrite = std::chrono::steady_clock::now();
+public:
+    SimpleTgOffsetCheckpoint(std::string path, std::size_t batch_size = 32, std::chrono::steady_clock::duration interval = std::chrono::seconds(1));
+
+    SimpleTgOffsetCheckpoint(const SimpleTgOffsetCheckpoint &) = delete;
+
+    SimpleTgOffsetCheckpoint &operator=(const SimpleTgOffsetCheckpoint &) = delete;
+
+    ~SimpleTgOffsetCheckpoint();
+
+    // Offset to pass to the next getUpdates, empty when nothing was ever checkpointed
+    std::optional<std::int32_t> Offset()const;
+
+    // Records that everything before offset is handled
+    void Commit(std::int32_t offset);
+
+    bool Flush();
+private:
+    bool Write(std::int32_t offset);
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "simple/tg_bot.hpp"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+
+// Fire and forget coroutine for multi-step flows, requires C++20:
+//
+//     SimpleTgConversation AskName(SimpleTgBot &bot, TgBot::Message::Ptr start) {
+//         bot.ReplyMessage(start, "What is your name?");
+//         auto name = co_await bot.NextMessage(start, std::chrono::minutes(5));
+//         if(!name)
+//             co_return; // timed out
+//         ...
+//     }
+//
+// While suspended a conversation is just its coroutine frame plus one entry in the bot's wait table,
+// no thread is blocked. Frame is freed when the coroutine finishes, exceptions are reported through bot's Log.
+class SimpleTgConversation {
+public:
+    struct promise_type {
+        SimpleTgBot *Bot = nullptr;
+        std::exception_ptr Exception;
+
+        SimpleTgConversation get_return_object() {
+            return {};
+        }
+
+        std::suspend_never initial_suspend()noexcept {
+            return {};
+        }
+
+        struct FinalAwaiter {
+            bool await_ready()noexcept {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<promise_type> handle)noexcept {
+                SimpleTgBot *bot = handle.promise().Bot;
+                std::exception_ptr exception = handle.promise().Exception;
+
+                handle.destroy();
+
+                if(exception)
+                    Report(bot, exception);
+            }
+
+            void await_resume()noexcept {}
+        };
+
+        FinalAwaiter final_suspend()noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            Exception = std::current_exception();
+        }
+
+        template<typename AwaitableType>
+        AwaitableType &&await_transform(AwaitableType &&awaitable) {
+            using Awaitable = std::decay_t<AwaitableType>;
+
+            if constexpr (std::is_same_v<Awaitable, SimpleTgBot::MessageAwaiter> || std::is_same_v<Awaitable, SimpleTgBot::CallbackQueryAwaiter>)
+                Bot = awaitable.Bot;
+
+            return std::forward<AwaitableType>(awaitable);
+        }
+    };
+private:
+    static void Report(SimpleTgBot *bot, std::exception_ptr exception)noexcept {
+        try {
+            try {
+                std::rethrow_exception(exception);
+            } catch (const std::exception &e) {
+                if(bot)
+                    bot->Log("Conversation failed: %", e.what());
+                else
+                    Println("Conversation failed: %", e.what());
+            }
+        } catch (...) {}
+    }
+};
+
+#endif
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <tgbot/net/HttpParser.h>
+#include "simple/tg_bot.hpp"
+
+// Blocking HttpClient that keeps connections alive and shares them between every bot it is given to, https and
+// plain http urls (e.g. a local Bot API server) are served, port is taken from the url host when it has one.
+// Every step of a request, resolve included, is bounded by _timeout. A request failed on a reused connection is sent again only
+// when it surely was not executed: write failed, or, for get* methods, connection closed before any response byte
+class SimpleTgPooledHttpClient: public TgBot::HttpClient {
+public:
+    using Stream = boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
+private:
+    // Own io_context per connection, so deadlines of concurrent requests don't interfere
+    struct Connection;
+
+    mutable boost::asio::ssl::context m_SslContext;
+    TgBot::HttpParser m_Parser;
+
+    mutable std::mutex m_Lock;
+    // Keyed by "protocol://host:port"
+    mutable std::vector<std::pair<std::string, std::unique_ptr<Connection>>> m_Idle;
+    std::size_t m_MaxIdle;
+public:
+    SimpleTgPooledHttpClient(std::size_t max_idle = 8);
+
+    ~SimpleTgPooledHttpClient();
+
+    std::string makeRequest(const TgBot::Url& url, const std::vector<TgBot::HttpReqArg>& args) const override;
+private:
+    std::unique_ptr<Connection> Acquire(const TgBot::Url &url, std::chrono::seconds timeout, bool &reused) const;
+
+    void Release(const TgBot::Url &url, std::unique_ptr<Connection> connection) const;
+};
+
+// Hosts many bots in one process: long polls of all tokens are multiplexed on a single asio thread,
+// handlers run on a shared worker pool. Updates of one bot are handled serially, as with LongPoll,
+// and bots take turns on the workers in batches, so one flooded bot can't starve the others.
+class SimpleTgBotHost {
+    static constexpr std::size_t UpdatesPerTurn = 8;
+    // Resolve, connect and handshake of a poll connection together
+    static constexpr std::chrono::seconds ConnectTimeout{10};
+
+    struct Connection;
+    struct HostedBot;
+
+    boost::asio::io_context m_Context;
+    boost::asio::ssl::context m_SslContext;
+    boost::asio::thread_pool m_Workers;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_Work;
+    std::string m_ApiHost;
+
+    std::vector<std::shared_ptr<HostedBot>> m_Bots;
+    std::vector<std::shared_ptr<Connection>> m_IdleConnections;
+    std::size_t m_MaxIdleConnections;
+
+    SimpleTgPooledHttpClient m_HttpClient;
+public:
+    SimpleTgBotHost(std::size_t workers = std::max(2u, std::thread::hardware_concurrency()), std::size_t max_idle_connections = 16, std::string api_host = "api.telegram.org");
+
+    ~SimpleTgBotHost();
+
+    // Client to construct hosted bots with, so their outbound calls share connections as well
+    const TgBot::HttpClient &GetHttpClient()const;
+
+    void Add(SimpleTgBot &bot, std::int32_t limit = 100, std::int32_t timeout = 10, std::vector<std::string> &&allowed_updates = {});
+
+    // Runs the poll loop on the calling thread until Stop
+    void Run();
+
+    void Stop();
+private:
+    void Poll(std::shared_ptr<HostedBot> bot);
+
+    void OnPollResponse(std::shared_ptr<HostedBot> bot, const std::string &body);
+
+    void OnPollError(std::shared_ptr<HostedBot> bot, const std::string &reason);
+
+    void Drain(std::shared_ptr<HostedBot> bot);
+
+    void Connect(std::function<void(std::shared_ptr<Connection>, boost::system::error_code)> callback);
+
+    void Release(std::shared_ptr<Connection> connection);
+};
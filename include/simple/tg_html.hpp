@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Builds text for ParseMode HTML in one reserved buffer, text is escaped on append, tags are balanced by the builder
+class SimpleTgHtmlBuilder {
+    std::string m_Buffer;
+    std::vector<std::string> m_OpenTags;
+public:
+    static constexpr std::size_t MessageLimit = 4096;
+
+    SimpleTgHtmlBuilder(std::size_t reserve = MessageLimit);
+
+    SimpleTgHtmlBuilder &Text(std::string_view text);
+
+    SimpleTgHtmlBuilder &Line(std::string_view text = {});
+
+    // Trusted markup, appended as is
+    SimpleTgHtmlBuilder &Raw(std::string_view html);
+
+    // Tag may carry attributes, e.g. "span class=\"tg-spoiler\"", Close emits the name only
+    SimpleTgHtmlBuilder &Open(std::string_view tag);
+
+    SimpleTgHtmlBuilder &Close();
+
+    SimpleTgHtmlBuilder &Tagged(std::string_view tag, std::string_view text);
+
+    SimpleTgHtmlBuilder &Bold(std::string_view text) { return Tagged("b", text); }
+
+    SimpleTgHtmlBuilder &Italic(std::string_view text) { return Tagged("i", text); }
+
+    SimpleTgHtmlBuilder &Code(std::string_view text) { return Tagged("code", text); }
+
+    SimpleTgHtmlBuilder &Pre(std::string_view text) { return Tagged("pre", text); }
+
+    SimpleTgHtmlBuilder &Link(std::string_view url, std::string_view text);
+
+    // Closes whatever is still open
+    const std::string &Str();
+
+    std::string Take();
+
+    std::vector<std::string> Split(std::size_t limit = MessageLimit);
+
+    void Clear();
+
+    static void AppendEscaped(std::string &out, std::string_view text);
+
+    static std::string Escape(std::string_view text);
+
+    // Cuts well formed Telegram html into parts under limit bytes, preferring line and then word boundaries.
+    // Tags open at a cut are closed at the end of one part and reopened at the start of the next
+    static std::vector<std::string> SplitMessage(std::string_view html, std::size_t limit = MessageLimit);
+};
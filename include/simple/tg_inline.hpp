@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <tgbot/Bot.h>
+
+struct InlineQueryAnswer {
+    std::vector<TgBot::InlineQueryResult::Ptr> Results;
+    // Passed back as offset of the query for the next page, empty when there are no more results
+    std::string NextOffset;
+    // Seconds Telegram may cache the answer on its side, the bot's own cache keeps it as long
+    std::int32_t CacheTime = 300;
+    // Personal answers are cached for the user that asked only
+    bool Personal = false;
+
+    InlineQueryAnswer(std::vector<TgBot::InlineQueryResult::Ptr> results = {}, std::string next_offset = "", std::int32_t cache_time = 300, bool personal = false) :
+        Results(std::move(results)),
+        NextOffset(std::move(next_offset)),
+        CacheTime(cache_time),
+        Personal(personal)
+    {}
+};
+
+// LRU of inline query answers keyed by normalized query text and offset, shared by all users unless personal.
+// Answers expire after their CacheTime, expired ones are misses
+class SimpleTgInlineResultCache {
+public:
+    using AnswerPtr = std::shared_ptr<const InlineQueryAnswer>;
+private:
+    struct Entry {
+        std::string Key;
+        AnswerPtr Answer;
+        std::chrono::steady_clock::time_point Expires;
+    };
+
+    std::size_t m_Capacity;
+
+    mutable std::mutex m_Lock;
+    // Most recently used first
+    std::list<Entry> m_Entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_Index;
+public:
+    SimpleTgInlineResultCache(std::size_t capacity = 1024);
+
+    SimpleTgInlineResultCache(const SimpleTgInlineResultCache &) = delete;
+
+    SimpleTgInlineResultCache &operator=(const SimpleTgInlineResultCache &) = delete;
+
+    // Zero capacity disables caching
+    void SetCapacity(std::size_t capacity);
+
+    // Shared answer first, then personal one of the user
+    AnswerPtr Find(const TgBot::InlineQuery &query);
+
+    void Insert(const TgBot::InlineQuery &query, AnswerPtr answer);
+
+    // For when data behind the answers changed
+    void Clear();
+
+    std::size_t Size()const;
+
+    // Trimmed, whitespace runs collapsed to a single space, ascii lowercased
+    static std::string Normalize(const std::string &query);
+private:
+    static std::string Key(const TgBot::InlineQuery &query, bool personal);
+
+    AnswerPtr FindLocked(const std::string &key);
+};
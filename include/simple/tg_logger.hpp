@@ -3,6 +3,10 @@
 #include <fstream>
 #include <chrono>
 #include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
 #include <tgbot/Bot.h>
 #include <bsl/format.hpp>
 
@@ -23,9 +27,26 @@ class SimpleTgLogger{
 	std::int64_t m_TopicId;
 
 	std::map<std::int64_t, LoggedMessage> m_LastMessages;
+
+	mutable std::mutex m_Lock;
+	mutable std::condition_variable m_Changed;
+	bool m_IsResolved = false;
+	bool m_IsStopping = false;
+	// Messages not yet handed to the sender thread
+	std::vector<std::string> m_PendingMessages;
+	// Looks the chat up, then sends queued messages, declared last so it is joined before anything it touches is gone
+	std::thread m_Sender;
 public:
 	SimpleTgLogger(const std::string &token, std::int64_t log_chat, const std::string &bot_name, std::int64_t topic_id = 0);
 
+	SimpleTgLogger(const SimpleTgLogger &) = delete;
+
+	SimpleTgLogger &operator=(const SimpleTgLogger &) = delete;
+
+	// Sends what is still queued before returning
+	~SimpleTgLogger();
+
+	// Waits for the chat lookup started by constructor
 	bool IsValid()const;
 
 	void SetEnabled(bool is) {
@@ -36,10 +57,15 @@ public:
 		return m_IsEnabled;
 	}
 
+	// Queued for the sender thread, never blocks on the network
 	void Log(const std::string &message);
 	
 	template<typename...ArgsType>
 	void Log(const char* fmt, ArgsType&&...args) {
 		return Log(Format(fmt, std::forward<ArgsType>(args)...));
 	}
+private:
+	void RunSender();
+
+	void Send(const std::string &message);
 };
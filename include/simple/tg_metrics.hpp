@@ -0,0 +1,151 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <tgbot/Bot.h>
+
+// Low-overhead counters and power-of-two histograms. Every thread writes into its own shard,
+// so recording never takes a lock, shards are only summed up when someone pulls a snapshot.
+class SimpleTgMetrics {
+public:
+    // Bucket i counts values <= 2^i, the last bucket collects everything above
+    static constexpr std::size_t BucketsCount = 28;
+    static constexpr std::size_t MaxSeries = 128;
+
+    enum class SeriesKind {
+        ApiCall,
+        Handler,
+        UpdateBatch,
+        PollLag
+    };
+
+    struct Histogram {
+        std::uint64_t Count = 0;
+        std::uint64_t Errors = 0;
+        std::uint64_t Sum = 0;
+        std::array<std::uint64_t, BucketsCount> Buckets = {};
+    };
+
+    struct Snapshot {
+        // Latencies are in microseconds
+        std::map<std::string, Histogram> ApiCalls;
+        std::map<std::string, Histogram> Handlers;
+        // Amount of updates returned by a single getUpdates
+        Histogram UpdateBatches;
+        // Time between telegram receiving an update and us dispatching it, microseconds
+        Histogram PollLag;
+    };
+private:
+    struct Series {
+        std::atomic<std::uint64_t> Count{0};
+        std::atomic<std::uint64_t> Errors{0};
+        std::atomic<std::uint64_t> Sum{0};
+        std::array<std::atomic<std::uint64_t>, BucketsCount> Buckets{};
+    };
+
+    struct Shard {
+        std::array<Series, MaxSeries> Entries;
+    };
+
+    // Shards of exited threads, handed to the next thread that records. Shared, so a thread exiting after
+    // metrics are gone has nowhere to return its shard to and just drops it
+    struct FreeShards {
+        std::mutex Lock;
+        std::vector<Shard*> Shards;
+    };
+
+    struct ShardReturn {
+        std::weak_ptr<FreeShards> Free;
+
+        void operator()(Shard *shard)const;
+    };
+
+    struct LocalState {
+        std::uint64_t MetricsId;
+        std::unique_ptr<Shard, ShardReturn> Owner;
+        std::array<std::unordered_map<std::string, std::size_t>, 2> SeriesIndices;
+    };
+
+    struct SeriesName {
+        SeriesKind Kind;
+        std::string Name;
+    };
+
+    static constexpr std::size_t UpdateBatchSeries = 0;
+    static constexpr std::size_t PollLagSeries = 1;
+    // Names past MaxSeries are counted as "other" of their own kind
+    static constexpr std::size_t ApiCallOverflowSeries = 2;
+    static constexpr std::size_t HandlerOverflowSeries = 3;
+    static constexpr std::size_t FirstNamedSeries = 4;
+
+    const std::uint64_t m_Id;
+
+    mutable std::mutex m_Lock;
+    std::vector<std::unique_ptr<Shard>> m_Shards;
+    std::shared_ptr<FreeShards> m_FreeShards = std::make_shared<FreeShards>();
+    std::map<std::pair<SeriesKind, std::string>, std::size_t> m_SeriesIndices;
+    std::vector<SeriesName> m_SeriesNames;
+public:
+    SimpleTgMetrics();
+
+    SimpleTgMetrics(const SimpleTgMetrics &) = delete;
+
+    SimpleTgMetrics &operator=(const SimpleTgMetrics &) = delete;
+
+    void RecordApiCall(const std::string &method, std::chrono::steady_clock::duration latency, bool failed);
+
+    void RecordHandler(const std::string &name, std::chrono::steady_clock::duration duration, bool failed);
+
+    void RecordUpdateBatch(std::size_t size);
+
+    void RecordPollLag(std::chrono::system_clock::duration lag);
+
+    Snapshot Collect()const;
+
+    std::string ToPrometheusText()const;
+
+    static std::size_t BucketIndex(std::uint64_t value);
+private:
+    void Record(std::size_t series, std::uint64_t value, bool failed);
+
+    std::size_t FindSeries(SeriesKind kind, const std::string &name);
+
+    LocalState &Local();
+};
+
+// HttpClient decorator, measures every Bot API request made through it
+class SimpleTgMetricsHttpClient: public TgBot::HttpClient {
+    const TgBot::HttpClient &m_Client;
+    SimpleTgMetrics &m_Metrics;
+public:
+    SimpleTgMetricsHttpClient(SimpleTgMetrics &metrics, const TgBot::HttpClient &client);
+
+    std::string makeRequest(const TgBot::Url& url, const std::vector<TgBot::HttpReqArg>& args) const override;
+
+    static std::string GetMethodName(const std::string &path);
+};
+
+// Serves SimpleTgMetrics in prometheus text format from a background thread
+class SimpleTgMetricsExporter {
+    // Keeps asio out of this header
+    struct Server;
+
+    std::unique_ptr<Server> m_Server;
+public:
+    SimpleTgMetricsExporter(const SimpleTgMetrics &metrics);
+
+    ~SimpleTgMetricsExporter();
+
+    bool Start(std::uint16_t port, const std::string &address = "127.0.0.1");
+
+    void Stop();
+
+    bool IsRunning()const;
+};
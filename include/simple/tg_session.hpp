@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <string>
+#include <type_traits>
+
+// Per (chat_id, user_id) state with fixed-size values, stored in an open-addressing hash table
+// that lives in a memory-mapped file, so a restarted bot picks its sessions up without loading anything.
+// Table is split into shards with own locks, handlers of different users rarely wait for each other.
+// Capacity is fixed when the file is created, shards get twice as many slots so probe chains stay short,
+// Set fails once a shard holds its share of capacity.
+// File is locked for exclusive use, a second store on the same path, in this or another process, is not valid
+class SimpleTgSessionStore {
+    struct Header;
+
+    struct Shard {
+        mutable std::mutex Lock;
+        std::uint8_t *Slots = nullptr;
+    };
+
+    std::string m_Path;
+    std::size_t m_ValueSize = 0;
+    std::size_t m_SlotSize = 0;
+    std::size_t m_ShardSlots = 0;
+    std::size_t m_ShardLimit = 0;
+    std::size_t m_MappingSize = 0;
+
+    std::uint8_t *m_Mapping = nullptr;
+    Header *m_Header = nullptr;
+    std::unique_ptr<Shard[]> m_Shards;
+    std::size_t m_ShardsCount = 0;
+
+#ifdef _WIN32
+    void *m_FileHandle = nullptr;
+    void *m_MappingHandle = nullptr;
+#else
+    int m_FileDescriptor = -1;
+#endif
+public:
+    using Modifier = std::function<void(void *value, bool created)>;
+
+    // Opens existing store or creates a new one, existing file must have been created with the same value size
+    SimpleTgSessionStore(const std::string &path, std::size_t value_size, std::size_t capacity = 1 << 20);
+
+    SimpleTgSessionStore(const SimpleTgSessionStore &) = delete;
+
+    SimpleTgSessionStore &operator=(const SimpleTgSessionStore &) = delete;
+
+    ~SimpleTgSessionStore();
+
+    bool IsValid()const;
+
+    // Copies at most size bytes of the value, rest of the slot is zero-filled on write
+    bool Read(std::int64_t chat_id, std::int64_t user_id, void *value, std::size_t size);
+
+    bool Write(std::int64_t chat_id, std::int64_t user_id, const void *value, std::size_t size);
+
+    // Runs modifier under the shard lock, new sessions start zero-filled
+    bool Modify(std::int64_t chat_id, std::int64_t user_id, const Modifier &modifier);
+
+    bool Erase(std::int64_t chat_id, std::int64_t user_id);
+
+    std::size_t Size()const;
+
+    std::size_t Capacity()const;
+
+    // Asks OS to write dirty pages to disk, it would do so eventually anyway
+    bool Flush();
+
+    template<typename Type>
+    std::optional<Type> Get(std::int64_t chat_id, std::int64_t user_id);
+
+    template<typename Type>
+    bool Set(std::int64_t chat_id, std::int64_t user_id, const Type &value);
+
+    template<typename Type, typename FunctionType>
+    bool Update(std::int64_t chat_id, std::int64_t user_id, FunctionType &&function);
+private:
+    bool Map(std::size_t capacity);
+
+    void Unmap();
+
+    Shard &ShardOf(std::uint64_t hash);
+
+    std::uint8_t *Slot(const Shard &shard, std::size_t index)const;
+
+    std::uint64_t &ShardSize(const Shard &shard)const;
+
+    std::size_t HomeIndex(std::uint64_t hash)const;
+
+    // Returns slot with the key or the empty slot where it would go, nullptr if shard is full
+    std::uint8_t *Find(Shard &shard, std::uint64_t hash, std::int64_t chat_id, std::int64_t user_id, bool &found);
+
+    static std::uint64_t Hash(std::int64_t chat_id, std::int64_t user_id);
+};
+
+template<typename Type>
+std::optional<Type> SimpleTgSessionStore::Get(std::int64_t chat_id, std::int64_t user_id) {
+    static_assert(std::is_trivially_copyable_v<Type>, "Session value must be trivially copyable to live in a mapped file");
+
+    if(sizeof(Type) > m_ValueSize)
+        return std::nullopt;
+
+    // Raw storage, Type does not have to be default constructible
+    alignas(Type) unsigned char storage[sizeof(Type)];
+    if(!Read(chat_id, user_id, storage, sizeof(Type)))
+        return std::nullopt;
+
+    return *std::launder(reinterpret_cast<Type*>(storage));
+}
+
+template<typename Type>
+bool SimpleTgSessionStore::Set(std::int64_t chat_id, std::int64_t user_id, const Type &value) {
+    static_assert(std::is_trivially_copyable_v<Type>, "Session value must be trivially copyable to live in a mapped file");
+
+    if(sizeof(Type) > m_ValueSize)
+        return false;
+
+    return Write(chat_id, user_id, &value, sizeof(Type));
+}
+
+template<typename Type, typename FunctionType>
+bool SimpleTgSessionStore::Update(std::int64_t chat_id, std::int64_t user_id, FunctionType &&function) {
+    static_assert(std::is_trivially_copyable_v<Type>, "Session value must be trivially copyable to live in a mapped file");
+
+    if(sizeof(Type) > m_ValueSize)
+        return false;
+
+    return Modify(chat_id, user_id, [&](void *slot, bool) {
+        // Copied out, slot is only 8-byte aligned
+        alignas(Type) unsigned char storage[sizeof(Type)];
+        std::memcpy(storage, slot, sizeof(Type));
+
+        Type &value = *std::launder(reinterpret_cast<Type*>(storage));
+        function(value);
+
+        std::memcpy(slot, storage, sizeof(Type));
+    });
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Hierarchical timing wheel: 4 levels of 256 slots, timers are kept in intrusive lists inside one node pool,
+// so schedule and cancel are O(1) no matter how many timers are pending. Timers fire on the wheel's own thread,
+// started on first schedule, independently of whatever the poll loop is blocked on.
+class SimpleTgTimerWheel {
+public:
+    using Callback = std::function<void()>;
+    using ErrorHandler = std::function<void(const std::string &)>;
+    // Zero is never a valid id
+    using TimerId = std::uint64_t;
+
+    static constexpr std::size_t Levels = 4;
+    static constexpr std::size_t SlotBits = 8;
+    static constexpr std::size_t Slots = 1 << SlotBits;
+private:
+    static constexpr std::uint32_t Nil = 0xffffffff;
+
+    struct Node {
+        Callback Function;
+        std::uint64_t Expiry = 0;
+        std::uint32_t Prev = Nil;
+        std::uint32_t Next = Nil;
+        std::uint32_t Slot = Nil;
+        std::uint32_t Generation = 0;
+    };
+
+    const std::chrono::steady_clock::time_point m_Origin = std::chrono::steady_clock::now();
+    const std::chrono::steady_clock::duration m_Tick;
+
+    std::mutex m_Lock;
+    std::condition_variable m_Signal;
+    std::vector<Node> m_Nodes;
+    std::vector<std::uint32_t> m_FreeNodes;
+    std::array<std::uint32_t, Levels * Slots> m_Heads;
+    std::array<std::size_t, Levels> m_LevelSizes = {};
+    std::uint64_t m_CurrentTick = 0;
+    std::size_t m_Size = 0;
+
+    std::thread m_Thread;
+    bool m_Stopping = false;
+    // Set when Stop runs on the wheel thread, which is then detached and must not touch the wheel anymore
+    std::shared_ptr<std::atomic<bool>> m_Detached = std::make_shared<std::atomic<bool>>(false);
+    ErrorHandler m_OnError;
+public:
+    SimpleTgTimerWheel(std::chrono::steady_clock::duration tick = std::chrono::milliseconds(10));
+
+    SimpleTgTimerWheel(const SimpleTgTimerWheel &) = delete;
+
+    SimpleTgTimerWheel &operator=(const SimpleTgTimerWheel &) = delete;
+
+    ~SimpleTgTimerWheel();
+
+    TimerId ScheduleAfter(std::chrono::steady_clock::duration delay, Callback callback);
+
+    TimerId ScheduleAt(std::chrono::steady_clock::time_point time, Callback callback);
+
+    // False if timer already fired, is firing right now or was cancelled before
+    bool Cancel(TimerId id);
+
+    std::size_t Size();
+
+    // Fires everything due by now on the calling thread, the wheel thread does it on its own
+    void Advance(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    // Safe to call from a callback, wheel thread is detached then instead of joined
+    void Stop();
+
+    // Gets what() of exceptions escaping callbacks, they are dropped silently without one
+    void OnError(ErrorHandler handler);
+private:
+    std::uint64_t ToTick(std::chrono::steady_clock::time_point time)const;
+
+    void Insert(std::uint32_t index);
+
+    void Unlink(std::uint32_t index);
+
+    void Release(std::uint32_t index);
+
+    // Moves due callbacks out, must be called under lock
+    void Collect(std::uint64_t tick, std::vector<Callback> &due);
+
+    // False when the wheel was stopped from one of the callbacks, nothing of it may be touched then
+    static bool Fire(std::vector<Callback> &due, const ErrorHandler &on_error, const std::shared_ptr<std::atomic<bool>> &detached);
+
+    void Run();
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <tgbot/Bot.h>
+
+struct TraceSpan {
+    std::string Name;
+    const char *Category = "";
+    std::int64_t Start = 0;
+    std::int64_t Duration = 0;
+    std::uint32_t ThreadId = 0;
+    std::int64_t ChatId = 0;
+};
+
+struct SlowHandler {
+    std::string Name;
+    std::int64_t ChatId = 0;
+    std::chrono::steady_clock::duration Elapsed;
+};
+
+// Collects timing spans into a bounded ring buffer and watches handlers running for too long.
+// Spans store only name, timing and chat, no stacks, so tracing can stay enabled in production.
+class SimpleTgTracer {
+public:
+    using SlowHandlerCallback = std::function<void(const SlowHandler &)>;
+
+    class Span {
+        SimpleTgTracer *m_Tracer;
+        TraceSpan m_Span;
+    public:
+        // Name is copied only when tracer is set, so disabled tracing costs nothing per span
+        Span(SimpleTgTracer *tracer, std::string_view name, const char *category, std::int64_t chat_id = 0);
+
+        Span(const Span &) = delete;
+
+        Span &operator=(const Span &) = delete;
+
+        ~Span();
+    };
+
+    class HandlerScope {
+        SimpleTgTracer *m_Tracer;
+        std::uint64_t m_Id = 0;
+        Span m_Span;
+    public:
+        HandlerScope(SimpleTgTracer *tracer, std::string_view name, std::int64_t chat_id);
+
+        HandlerScope(const HandlerScope &) = delete;
+
+        HandlerScope &operator=(const HandlerScope &) = delete;
+
+        ~HandlerScope();
+    };
+private:
+    struct RunningHandler {
+        std::string Name;
+        std::int64_t ChatId;
+        std::chrono::steady_clock::time_point Start;
+        bool Reported = false;
+    };
+
+    const std::chrono::steady_clock::time_point m_Origin = std::chrono::steady_clock::now();
+
+    mutable std::mutex m_SpansLock;
+    std::vector<TraceSpan> m_Spans;
+    std::size_t m_NextSpan = 0;
+    bool m_Wrapped = false;
+
+    std::mutex m_HandlersLock;
+    std::condition_variable m_WatchdogSignal;
+    std::map<std::uint64_t, RunningHandler> m_RunningHandlers;
+    std::uint64_t m_NextHandlerId = 1;
+    std::chrono::steady_clock::duration m_Budget = std::chrono::seconds(5);
+    SlowHandlerCallback m_OnSlowHandler;
+    bool m_WatchdogRunning = false;
+    std::thread m_Watchdog;
+public:
+    SimpleTgTracer(std::size_t capacity = 65536);
+
+    ~SimpleTgTracer();
+
+    void Add(TraceSpan span);
+
+    std::vector<TraceSpan> Spans()const;
+
+    void Clear();
+
+    // Chrome trace-event JSON, open it in chrome://tracing or ui.perfetto.dev
+    std::string ToChromeTrace()const;
+
+    bool WriteChromeTrace(const std::string &path)const;
+
+    void StartWatchdog(std::chrono::steady_clock::duration budget, SlowHandlerCallback callback);
+
+    void StopWatchdog();
+
+    std::int64_t Now()const;
+private:
+    std::uint64_t BeginHandler(std::string_view name, std::int64_t chat_id);
+
+    void EndHandler(std::uint64_t id);
+
+    void WatchdogLoop();
+};
+
+// HttpClient decorator, puts a span around every outbound Bot API request
+class SimpleTgTracingHttpClient: public TgBot::HttpClient {
+    const TgBot::HttpClient &m_Client;
+    SimpleTgTracer &m_Tracer;
+public:
+    SimpleTgTracingHttpClient(SimpleTgTracer &tracer, const TgBot::HttpClient &client);
+
+    std::string makeRequest(const TgBot::Url& url, const std::vector<TgBot::HttpReqArg>& args) const override;
+};
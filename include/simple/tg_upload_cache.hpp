@@ -0,0 +1,67 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Maps content hash of uploaded media to file_id Telegram gave back for it, so the same bytes are uploaded once.
+// Least recently used entries are evicted above capacity. With a path, entries survive restarts: file is loaded
+// on construction and rewritten through a temporary file by a background writer every batch_size inserts,
+// and synchronously on Flush/destruction, so senders never wait for the disk.
+class SimpleTgUploadCache {
+    using Entry = std::pair<std::uint64_t, std::string>;
+
+    std::string m_Path;
+    std::size_t m_Capacity;
+    std::size_t m_BatchSize;
+
+    mutable std::mutex m_Lock;
+    // Most recently used first
+    std::list<Entry> m_Entries;
+    std::unordered_map<std::uint64_t, std::list<Entry>::iterator> m_Index;
+    std::size_t m_PendingWrites = 0;
+
+    // Taken before m_Lock, keeps snapshots from reaching the file out of order
+    std::mutex m_WriteLock;
+    std::condition_variable m_WriteRequested;
+    bool m_Stopping = false;
+    std::thread m_Writer;
+public:
+    SimpleTgUploadCache(std::string path = "", std::size_t capacity = 4096, std::size_t batch_size = 16);
+
+    SimpleTgUploadCache(const SimpleTgUploadCache &) = delete;
+
+    SimpleTgUploadCache &operator=(const SimpleTgUploadCache &) = delete;
+
+    ~SimpleTgUploadCache();
+
+    std::optional<std::string> Find(std::uint64_t hash);
+
+    void Insert(std::uint64_t hash, std::string file_id);
+
+    // For file ids Telegram no longer accepts
+    void Erase(std::uint64_t hash);
+
+    std::size_t Size()const;
+
+    bool Flush();
+
+    // xxHash64, several GB/s, so hashing is negligible next to an upload
+    static std::uint64_t Hash(std::string_view data, std::uint64_t seed = 0);
+private:
+    void Touch(std::uint64_t hash, std::string file_id);
+
+    void RunWriter();
+
+    bool Write();
+
+    bool WriteFile(const std::vector<Entry> &entries)const;
+};
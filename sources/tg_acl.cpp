@@ -0,0 +1,209 @@
+#include "simple/tg_acl.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+static std::atomic<std::uint64_t> s_NextAclId{1};
+
+SimpleTgIdSet::SimpleTgIdSet(std::vector<std::int64_t> ids, bool use_bloom):
+    m_Ids(std::move(ids))
+{
+    std::sort(m_Ids.begin(), m_Ids.end());
+    m_Ids.erase(std::unique(m_Ids.begin(), m_Ids.end()), m_Ids.end());
+    m_Ids.shrink_to_fit();
+
+    // Small lists fit in a couple of cache lines, bloom filter won't beat the binary search there
+    if(!use_bloom || m_Ids.size() < 64)
+        return;
+
+    std::size_t bits = 64;
+    while(bits < m_Ids.size() * BloomBitsPerId)
+        bits <<= 1;
+
+    m_Bloom.resize(bits / 64);
+    m_BloomMask = bits - 1;
+
+    for (std::int64_t id : m_Ids) {
+        std::uint64_t hash = Hash(id);
+        std::uint64_t step = (hash >> 32) | 1;
+
+        for (std::size_t i = 0; i < BloomHashes; i++, hash += step) {
+            std::uint64_t bit = hash & m_BloomMask;
+            m_Bloom[bit / 64] |= std::uint64_t(1) << (bit % 64);
+        }
+    }
+}
+
+bool SimpleTgIdSet::Contains(std::int64_t id)const {
+    if(m_Ids.empty() || !MayContain(id))
+        return false;
+
+    return std::binary_search(m_Ids.begin(), m_Ids.end(), id);
+}
+
+bool SimpleTgIdSet::MayContain(std::int64_t id)const {
+    if(m_Bloom.empty())
+        return true;
+
+    std::uint64_t hash = Hash(id);
+    std::uint64_t step = (hash >> 32) | 1;
+
+    for (std::size_t i = 0; i < BloomHashes; i++, hash += step) {
+        std::uint64_t bit = hash & m_BloomMask;
+
+        if(!(m_Bloom[bit / 64] & (std::uint64_t(1) << (bit % 64))))
+            return false;
+    }
+
+    return true;
+}
+
+std::uint64_t SimpleTgIdSet::Hash(std::int64_t id) {
+    // splitmix64 finalizer
+    std::uint64_t x = static_cast<std::uint64_t>(id);
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+bool SimpleTgAclRules::IsLegit(std::int64_t chat_id, std::int64_t user_id)const {
+    if(DeniedUsers.Contains(user_id) || DeniedChats.Contains(chat_id))
+        return false;
+
+    if(AllowedUsers.IsEmpty() && AllowedChats.IsEmpty())
+        return true;
+
+    return AllowedUsers.Contains(user_id) || AllowedChats.Contains(chat_id);
+}
+
+std::shared_ptr<const SimpleTgAclRules> SimpleTgAcl::Builder::Build() {
+    auto rules = std::make_shared<SimpleTgAclRules>();
+
+    rules->AllowedUsers = SimpleTgIdSet(std::move(AllowedUsers), UseBloomFilter);
+    rules->AllowedChats = SimpleTgIdSet(std::move(AllowedChats), UseBloomFilter);
+    rules->DeniedUsers = SimpleTgIdSet(std::move(DeniedUsers), UseBloomFilter);
+    rules->DeniedChats = SimpleTgIdSet(std::move(DeniedChats), UseBloomFilter);
+
+    return rules;
+}
+
+SimpleTgAcl::SimpleTgAcl():
+    m_Id(s_NextAclId++),
+    m_Rules(std::make_shared<SimpleTgAclRules>())
+{}
+
+bool SimpleTgAcl::IsLegit(std::int64_t chat_id, std::int64_t user_id)const {
+    return LocalRules()->IsLegit(chat_id, user_id);
+}
+
+void SimpleTgAcl::Reload(Builder&& builder) {
+    Reload(builder.Build());
+}
+
+void SimpleTgAcl::Reload(std::shared_ptr<const SimpleTgAclRules> rules) {
+    if(!rules)
+        rules = std::make_shared<SimpleTgAclRules>();
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    m_Rules = std::move(rules);
+    m_Generation.fetch_add(1, std::memory_order_release);
+}
+
+bool SimpleTgAcl::ReloadFromFile(const std::string& path, bool use_bloom) {
+    std::ifstream file(path, std::ios::binary);
+
+    if(!file)
+        return false;
+
+    std::stringstream content;
+    content << file.rdbuf();
+
+    Builder builder;
+    builder.UseBloomFilter = use_bloom;
+
+    if(!ParseRules(content.str(), builder))
+        return false;
+
+    Reload(std::move(builder));
+    return true;
+}
+
+std::shared_ptr<const SimpleTgAclRules> SimpleTgAcl::Rules()const {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    return m_Rules;
+}
+
+std::shared_ptr<const SimpleTgAclRules> SimpleTgAcl::LocalRules()const {
+    // Keyed by id rather than address, a new acl at the address of a destroyed one must not see its rules
+    static thread_local std::vector<LocalSnapshot> s_Snapshots;
+
+    const std::uint64_t generation = m_Generation.load(std::memory_order_acquire);
+
+    LocalSnapshot *local = nullptr;
+
+    for (auto &snapshot : s_Snapshots) {
+        if (snapshot.AclId == m_Id) {
+            local = &snapshot;
+            break;
+        }
+    }
+
+    if (local && local->Generation == generation) {
+        if(auto rules = local->Rules.lock())
+            return rules;
+    }
+
+    if (!local) {
+        // Entries of destroyed acls have nothing left to point at
+        s_Snapshots.erase(std::remove_if(s_Snapshots.begin(), s_Snapshots.end(), [](const LocalSnapshot &snapshot) {
+            return snapshot.Rules.expired();
+        }), s_Snapshots.end());
+
+        s_Snapshots.push_back({m_Id, 0, {}});
+        local = &s_Snapshots.back();
+    }
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    local->Rules = m_Rules;
+    local->Generation = m_Generation.load(std::memory_order_relaxed);
+
+    return m_Rules;
+}
+
+bool SimpleTgAcl::ParseRules(const std::string& content, Builder& builder) {
+    std::istringstream stream(content);
+    std::string line;
+
+    while (std::getline(stream, line)) {
+        std::size_t comment = line.find('#');
+        if(comment != std::string::npos)
+            line.resize(comment);
+
+        std::istringstream line_stream(line);
+        std::string kind;
+        std::int64_t id = 0;
+
+        if(!(line_stream >> kind))
+            continue;
+
+        if(!(line_stream >> id))
+            return false;
+
+        if(kind == "allow_user")
+            builder.AllowedUsers.push_back(id);
+        else if(kind == "allow_chat")
+            builder.AllowedChats.push_back(id);
+        else if(kind == "deny_user")
+            builder.DeniedUsers.push_back(id);
+        else if(kind == "deny_chat")
+            builder.DeniedChats.push_back(id);
+        else
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,200 @@
+#include "simple/tg_admission.hpp"
+#include <algorithm>
+#include <bsl/format.hpp>
+
+// Maps are pruned once they grow past this, so raids by fresh accounts can't grow them forever
+static constexpr std::size_t PruneThreshold = 16384;
+
+static std::int64_t GetUserId(const TgBot::Update& update) {
+    if (update.message && update.message->from)
+        return update.message->from->id;
+    if (update.editedMessage && update.editedMessage->from)
+        return update.editedMessage->from->id;
+    if (update.callbackQuery && update.callbackQuery->from)
+        return update.callbackQuery->from->id;
+    if (update.inlineQuery && update.inlineQuery->from)
+        return update.inlineQuery->from->id;
+    return 0;
+}
+
+static std::int64_t GetChatId(const TgBot::Update& update) {
+    if (update.message)
+        return update.message->chat->id;
+    if (update.editedMessage)
+        return update.editedMessage->chat->id;
+    if (update.channelPost)
+        return update.channelPost->chat->id;
+    if (update.callbackQuery && update.callbackQuery->message)
+        return update.callbackQuery->message->chat->id;
+    return 0;
+}
+
+static std::uint32_t GetMessageDate(const TgBot::Update& update) {
+    if (update.message)
+        return update.message->date;
+    if (update.editedMessage)
+        return update.editedMessage->date;
+    if (update.channelPost)
+        return update.channelPost->date;
+    return 0;
+}
+
+static bool IsUrgent(const TgBot::Update& update) {
+    return update.callbackQuery || update.inlineQuery;
+}
+
+static std::uint64_t Mix(std::uint64_t hash, std::uint64_t value) {
+    hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+SimpleTgAdmission::SimpleTgAdmission(SimpleTgAdmissionLimits limits):
+    m_Limits(limits)
+{}
+
+void SimpleTgAdmission::Admit(std::vector<TgBot::Update::Ptr>& updates) {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    const auto now = std::chrono::steady_clock::now();
+    const auto wall_now = std::chrono::system_clock::now();
+
+    std::uint32_t newest = 0;
+    for (const auto &update : updates)
+        newest = std::max(newest, GetMessageDate(*update));
+
+    // Unlike a count of queued updates this drops back to zero as soon as the bot keeps up again
+    const auto lag = newest ? std::chrono::duration_cast<std::chrono::seconds>(wall_now - std::chrono::system_clock::from_time_t(newest)) : std::chrono::seconds(0);
+    const bool overloaded = lag > m_Limits.LagThreshold;
+    const auto stale_before = wall_now - m_Limits.StaleAge;
+
+    m_PeakLag = std::max(m_PeakLag, lag);
+
+    auto shed = [&](const TgBot::Update::Ptr &update) {
+        // Membership changes are rare and change what bot may do, always let them through
+        if(update->myChatMember || update->chatMember)
+            return false;
+
+        if (overloaded) {
+            const std::uint32_t date = GetMessageDate(*update);
+
+            if (date && std::chrono::system_clock::from_time_t(date) < stale_before) {
+                m_ShedStale++;
+                return true;
+            }
+        }
+
+        if (update->callbackQuery && IsDuplicatePress(*update->callbackQuery, now)) {
+            m_ShedDuplicates++;
+            return true;
+        }
+
+        const std::int64_t user = GetUserId(*update);
+        const std::int64_t chat = GetChatId(*update);
+
+        Bucket *user_bucket = user ? &Refill(m_UserBuckets, user, m_Limits.UserRate, m_Limits.UserBurst, now) : nullptr;
+        // Flooded group should not starve presses on its own buttons
+        Bucket *chat_bucket = chat && !IsUrgent(*update) ? &Refill(m_ChatBuckets, chat, m_Limits.ChatRate, m_Limits.ChatBurst, now) : nullptr;
+
+        // Tokens are spent only when both buckets let the update in, a throttled chat doesn't drain its users
+        if ((user_bucket && user_bucket->Tokens < 1.0) || (chat_bucket && chat_bucket->Tokens < 1.0)) {
+            m_ShedRateLimited++;
+            return true;
+        }
+
+        if(user_bucket)
+            user_bucket->Tokens -= 1.0;
+        if(chat_bucket)
+            chat_bucket->Tokens -= 1.0;
+
+        return false;
+    };
+
+    updates.erase(std::remove_if(updates.begin(), updates.end(), shed), updates.end());
+
+    std::stable_partition(updates.begin(), updates.end(), [](const TgBot::Update::Ptr &update) {
+        return IsUrgent(*update);
+    });
+
+    const double user_refill = m_Limits.UserRate > 0 ? m_Limits.UserBurst / m_Limits.UserRate : 0;
+    const double chat_refill = m_Limits.ChatRate > 0 ? m_Limits.ChatBurst / m_Limits.ChatRate : 0;
+
+    // Bucket that had time to refill is the same as no bucket
+    Prune(m_UserBuckets, [&](const Bucket &bucket) {
+        return std::chrono::duration<double>(now - bucket.Updated).count() >= user_refill;
+    });
+    Prune(m_ChatBuckets, [&](const Bucket &bucket) {
+        return std::chrono::duration<double>(now - bucket.Updated).count() >= chat_refill;
+    });
+    Prune(m_RecentPresses, [&](std::chrono::steady_clock::time_point time) {
+        return now - time >= m_Limits.DuplicateWindow;
+    });
+}
+
+std::optional<std::string> SimpleTgAdmission::TakeReport() {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    const auto now = std::chrono::steady_clock::now();
+
+    if(now - m_LastReport < m_Limits.ReportInterval)
+        return std::nullopt;
+
+    if(!m_ShedStale && !m_ShedRateLimited && !m_ShedDuplicates)
+        return std::nullopt;
+
+    std::string report = Format("Admission shed % stale, % rate limited, % duplicate callbacks, peak lag %s", m_ShedStale, m_ShedRateLimited, m_ShedDuplicates, m_PeakLag.count());
+
+    m_ShedStale = 0;
+    m_ShedRateLimited = 0;
+    m_ShedDuplicates = 0;
+    m_PeakLag = std::chrono::seconds(0);
+    m_LastReport = now;
+
+    return report;
+}
+
+SimpleTgAdmission::Bucket& SimpleTgAdmission::Refill(std::unordered_map<std::int64_t, Bucket>& buckets, std::int64_t id, double rate, double burst, std::chrono::steady_clock::time_point now) {
+    auto [it, inserted] = buckets.try_emplace(id, Bucket{burst, now});
+    Bucket &bucket = it->second;
+
+    if (!inserted) {
+        const double elapsed = std::chrono::duration<double>(now - bucket.Updated).count();
+        bucket.Tokens = std::min(burst, bucket.Tokens + elapsed * rate);
+        bucket.Updated = now;
+    }
+
+    return bucket;
+}
+
+bool SimpleTgAdmission::IsDuplicatePress(const TgBot::CallbackQuery& query, std::chrono::steady_clock::time_point now) {
+    std::uint64_t key = std::hash<std::string>()(query.data);
+    key = Mix(key, query.from ? query.from->id : 0);
+
+    if (query.message) {
+        key = Mix(key, query.message->chat->id);
+        key = Mix(key, query.message->messageId);
+    } else {
+        key = Mix(key, std::hash<std::string>()(query.inlineMessageId));
+    }
+
+    auto [it, inserted] = m_RecentPresses.try_emplace(key, now);
+
+    if(inserted)
+        return false;
+
+    const bool duplicate = now - it->second < m_Limits.DuplicateWindow;
+    it->second = now;
+    return duplicate;
+}
+
+template<typename KeyType, typename ValueType, typename PredicateType>
+void SimpleTgAdmission::Prune(std::unordered_map<KeyType, ValueType>& map, const PredicateType& expired) {
+    if(map.size() < PruneThreshold)
+        return;
+
+    for (auto it = map.begin(); it != map.end();) {
+        if(expired(it->second))
+            it = map.erase(it);
+        else
+            ++it;
+    }
+}
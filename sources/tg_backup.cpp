@@ -12,15 +12,19 @@ SimpleTgBackup::SimpleTgBackup(const std::string &token, std::int64_t backup_cha
 	m_BotName(bot_name),
 	m_ApplicationName(application_name)
 {
-	try {
-		m_BackupChat = m_Bot.getApi().getChat(m_BackupChatId);
-	} catch (const std::exception &exception) {
-		LogSimpleTgBackup(Error, "Can't get chat for chat_id % with token %, reason: %", m_BackupChatId, m_Bot.getToken(), exception.what());
-	}
+	// Gets everything by value, the backup may be moved while the lookup is still running
+	m_BackupChat = std::async(std::launch::async, [token, backup_chat]() -> TgBot::Chat::Ptr {
+		try {
+			return TgBot::Bot(token).getApi().getChat(backup_chat);
+		} catch (const std::exception &exception) {
+			LogSimpleTgBackup(Error, "Can't get chat for chat_id % with token %, reason: %", backup_chat, token, exception.what());
+		}
+		return nullptr;
+	}).share();
 }
 
 bool SimpleTgBackup::IsValid() const {
-	return (bool)m_BackupChat;
+	return (bool)m_BackupChat.get();
 }
 
 bool SimpleTgBackup::Backup(const std::map<std::string, std::string>& files) {
@@ -3,6 +3,12 @@
 #include <boost/range/algorithm.hpp>
 #include <boost/algorithm/string.hpp>
 #include <tgbot/net/BoostHttpOnlySslClient.h>
+#include <boost/asio/post.hpp>
+#include <boost/json.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <algorithm>
+#include <future>
+#include <sstream>
 
 #ifdef SendMessage
 #undef SendMessage
@@ -26,6 +32,142 @@ std::vector<KeyboardButton> Keyboard::ToKeyboardRow(const std::vector<std::strin
     return row;
 }
 
+PaginatedKeyboard::PaginatedKeyboard(std::string id, std::size_t size, ButtonBuilder builder, std::size_t row_size, std::size_t rows_per_page):
+    m_Id(std::move(id)),
+    m_Builder(std::move(builder)),
+    m_RowSize(row_size ? row_size : 1),
+    m_PageSize(m_RowSize * (rows_per_page ? rows_per_page : 1)),
+    m_Size(size)
+{}
+
+std::size_t PaginatedKeyboard::Size()const {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    return m_Size;
+}
+
+std::size_t PaginatedKeyboard::PagesCount()const {
+    return PagesCount(Size());
+}
+
+std::size_t PaginatedKeyboard::PagesCount(std::size_t size)const {
+    return std::max<std::size_t>((size + m_PageSize - 1) / m_PageSize, 1);
+}
+
+KeyboardLayout PaginatedKeyboard::Page(std::size_t page)const {
+    std::size_t size = 0;
+    std::size_t generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+
+        size = m_Size;
+        generation = m_Generation;
+        page = std::min(page, PagesCount(size) - 1);
+
+        auto cached = m_PageIndex.find(page);
+
+        if (cached != m_PageIndex.end()) {
+            m_CachedPages.splice(m_CachedPages.begin(), m_CachedPages, cached->second);
+            return cached->second->second;
+        }
+    }
+
+    const std::size_t pages = PagesCount(size);
+
+    KeyboardLayout layout;
+    std::vector<KeyboardButton> row;
+
+    const std::size_t begin = page * m_PageSize;
+    const std::size_t end = std::min(begin + m_PageSize, size);
+
+    for (std::size_t index = begin; index < end; index++) {
+        row.push_back(m_Builder(index));
+
+        if (row.size() == m_RowSize) {
+            layout.push_back(std::move(row));
+            row.clear();
+        }
+    }
+
+    if(row.size())
+        layout.push_back(std::move(row));
+
+    if (pages > 1) {
+        // Disabled buttons are skipped, so first and last pages show only the way back
+        layout.push_back({
+            KeyboardButton("<", PageCallbackData(page ? page - 1 : 0), page > 0),
+            KeyboardButton(Format("%/%", page + 1, pages), m_Id + '|'),
+            KeyboardButton(">", PageCallbackData(page + 1), page + 1 < pages)
+        });
+    }
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    // Another thread may have built the same page meanwhile, either copy will do
+    if(generation != m_Generation || m_PageIndex.count(page))
+        return layout;
+
+    m_CachedPages.emplace_front(page, layout);
+    m_PageIndex.emplace(page, m_CachedPages.begin());
+
+    if (m_CachedPages.size() > MaxCachedPages) {
+        m_PageIndex.erase(m_CachedPages.back().first);
+        m_CachedPages.pop_back();
+    }
+
+    return layout;
+}
+
+std::optional<std::size_t> PaginatedKeyboard::ParsePage(const std::string& callback_data)const {
+    if(callback_data.size() <= m_Id.size() + 1 || callback_data.compare(0, m_Id.size(), m_Id) != 0 || callback_data[m_Id.size()] != '|')
+        return std::nullopt;
+
+    std::size_t page = 0;
+
+    for (std::size_t i = m_Id.size() + 1; i < callback_data.size(); i++) {
+        const char ch = callback_data[i];
+
+        if (ch >= '0' && ch <= '9')
+            page = page * 36 + (ch - '0');
+        else if (ch >= 'a' && ch <= 'z')
+            page = page * 36 + (ch - 'a' + 10);
+        else
+            return std::nullopt;
+    }
+
+    return page;
+}
+
+void PaginatedKeyboard::Reset(std::size_t size) {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    m_Size = size;
+    m_Generation++;
+    m_CachedPages.clear();
+    m_PageIndex.clear();
+}
+
+std::string PaginatedKeyboard::PageCallbackData(std::size_t page)const {
+    char digits[16];
+    std::size_t count = 0;
+
+    do {
+        const std::size_t digit = page % 36;
+        digits[count++] = digit < 10 ? char('0' + digit) : char('a' + digit - 10);
+        page /= 36;
+    } while (page);
+
+    std::string data;
+    data.reserve(m_Id.size() + 1 + count);
+    data.append(m_Id);
+    data.push_back('|');
+
+    while(count)
+        data.push_back(digits[--count]);
+
+    return data;
+}
+
 static TgBot::InlineKeyboardMarkup::Ptr ToInlineKeyboardMarkup(const KeyboardLayout &keyboard) {
     if(!keyboard.size())
         return nullptr;
@@ -59,8 +201,11 @@ static TgBot::InlineKeyboardMarkup::Ptr ToInlineKeyboardMarkup(const KeyboardLay
     return keyboard_markup;
 }
 
-SimpleTgBot::SimpleTgBot(const std::string& token, const TgBot::HttpClient &client):
-	TgBot::Bot(token, client)
+SimpleTgBot::SimpleTgBot(const std::string& token, const TgBot::HttpClient &client, const std::string &url):
+	TgBot::Bot(token, client, url),
+    m_ApiUrl(url),
+    m_SendMessageUrl(Format("%/bot%/sendMessage", url, token)),
+    m_SendMediaGroupUrl(Format("%/bot%/sendMediaGroup", url, token))
 {
     auto handle_command = [this](TgBot::Message::Ptr message) {
         std::string command = ParseCommand(message);
@@ -85,15 +230,56 @@ SimpleTgBot::SimpleTgBot(const std::string& token, const TgBot::HttpClient &clie
     });
     getEvents().onUnknownCommand(handle_command);
 
-    try{
-        m_Username = getApi().getMe()->username;
-    } catch (const std::exception& e) {
-        Log("Failed to get bot identity: %", e.what());
-    }
+    m_Timers.OnError([this](const std::string &error) {
+        Log("Timer callback failed: %", error);
+    });
+
+    // Registered before any user handler, so waits see updates first and user wrappers can skip consumed ones.
+    // Same acl as for handlers, a denied user must not be able to answer somebody's wait
+    getEvents().onNonCommandMessage([this](TgBot::Message::Ptr message) {
+        if(!message->from || !IsLegit(message->chat->id, message->from->id))
+            return;
+        if(ResumeMessageWait(message))
+            m_ConsumedUpdate = message;
+    });
+    getEvents().onCallbackQuery([this](TgBot::CallbackQuery::Ptr query) {
+        if(!query->message || !query->from || !IsLegit(query->message->chat->id, query->from->id))
+            return;
+        if(ResumeCallbackQueryWait(query))
+            m_ConsumedUpdate = query;
+    });
+
+    m_Identity = std::async(std::launch::async, [this]() {
+        Identity identity;
+
+        try{
+            identity.Username = getApi().getMe()->username;
+        } catch (const std::exception& e) {
+            identity.Error = e.what();
+        }
+
+        return identity;
+    }).share();
+}
+
+const std::string& SimpleTgBot::GetUsername() {
+    const Identity &identity = m_Identity.get();
+
+    // Reported on first use, log handler is not set yet when constructor runs
+    if(identity.Error.size() && !m_IdentityErrorReported.exchange(true))
+        Log("Failed to get bot identity: %", identity.Error);
+
+    return identity.Username;
 }
 
 void SimpleTgBot::LongPoll(std::int32_t limit, std::int32_t timeout, std::vector<std::string> &&allowed_updates){
-	TgBot::TgLongPoll long_poll(*this, limit, timeout, std::make_shared<std::vector<std::string>>(std::move(allowed_updates)));
+	FastLongPoll long_poll(*this, limit, timeout, std::make_shared<std::vector<std::string>>(std::move(allowed_updates)), false);
+    long_poll.setMetrics(m_Metrics);
+    long_poll.setTracer(m_Tracer);
+    long_poll.setCheckpoint(m_Checkpoint, m_CatchUp);
+    long_poll.setAdmission(m_Admission, [this](const std::string &report) {
+        Log("%", report);
+    });
 
     while(true){
         try{
@@ -110,9 +296,14 @@ void SimpleTgBot::OnLongPollIteration() {
 }
 
 bool SimpleTgBot::IsLegit(std::int64_t chat_id, std::int64_t user_id) const {
-    (void)chat_id;
-    (void)user_id;
-    return true;
+    if(!m_Acl)
+        return true;
+
+    return m_Acl->IsLegit(chat_id, user_id);
+}
+
+void SimpleTgBot::SetAcl(const SimpleTgAcl* acl) {
+    m_Acl = acl;
 }
 
 void SimpleTgBot::OnLog(LogHandler handler){
@@ -126,7 +317,61 @@ void SimpleTgBot::Log(const std::string& message){
 	m_Log(message);
 }
 
+void SimpleTgBot::SetMetrics(SimpleTgMetrics* metrics) {
+    m_Metrics = metrics;
+}
+
+SimpleTgMetrics* SimpleTgBot::GetMetrics()const {
+    return m_Metrics;
+}
+
+void SimpleTgBot::SetTracer(SimpleTgTracer* tracer) {
+    m_Tracer = tracer;
+}
+
+void SimpleTgBot::SetUploadCache(SimpleTgUploadCache* cache) {
+    m_UploadCache = cache;
+}
+
+SimpleTgUploadCache* SimpleTgBot::GetUploadCache()const {
+    return m_UploadCache;
+}
+
+SimpleTgTracer* SimpleTgBot::GetTracer()const {
+    return m_Tracer;
+}
+
+void SimpleTgBot::SetCheckpoint(SimpleTgOffsetCheckpoint* checkpoint, bool catch_up) {
+    m_Checkpoint = checkpoint;
+    m_CatchUp = catch_up;
+}
+
+void SimpleTgBot::SetAdmission(SimpleTgAdmission* admission) {
+    m_Admission = admission;
+}
+
+SimpleTgAdmission* SimpleTgBot::GetAdmission()const {
+    return m_Admission;
+}
+
+SimpleTgOffsetCheckpoint* SimpleTgBot::GetCheckpoint()const {
+    return m_Checkpoint;
+}
+
+bool SimpleTgBot::IsCatchUpEnabled()const {
+    return m_CatchUp;
+}
+
+const std::string& SimpleTgBot::GetApiUrl()const {
+    return m_ApiUrl;
+}
+
 void SimpleTgBot::ClearOldUpdates(){
+    if (m_Checkpoint && m_Checkpoint->Offset()) {
+        Log("Resuming from checkpointed update offset %", *m_Checkpoint->Offset());
+        return;
+    }
+
     try{
         getApi().getUpdates(-1, 1);
     } catch (const std::exception& e) {
@@ -149,22 +394,79 @@ TgBot::Message::Ptr SimpleTgBot::SendMessage(std::int64_t chat, std::int32_t top
 }
 
 TgBot::Message::Ptr SimpleTgBot::SendMessage(std::int64_t chat, std::int32_t topic, const std::string& message, TgBot::GenericReply::Ptr reply, std::int64_t reply_message, bool silent) {
+    return SendMessage(chat, topic, std::string(message), std::move(reply), reply_message, silent);
+}
+
+static const TgBot::TgTypeParser &GetParser() {
+    static const TgBot::TgTypeParser parser;
+    return parser;
+}
+
+// Options never change, so every request shares one instance
+static TgBot::LinkPreviewOptions::Ptr GetDisabledLinkPreviewOptions() {
+    static const TgBot::LinkPreviewOptions::Ptr options = []() {
+        TgBot::LinkPreviewOptions::Ptr options(new TgBot::LinkPreviewOptions());
+        options->isDisabled = true;
+        return options;
+    }();
+
+    return options;
+}
+
+// Read only while the request is serialized on this thread, so one instance per thread is enough
+static TgBot::ReplyParameters::Ptr GetReplyParameters(std::int64_t chat, std::int64_t message) {
+    if(!message)
+        return nullptr;
+
+    thread_local TgBot::ReplyParameters::Ptr parameters(new TgBot::ReplyParameters());
+    parameters->chatId = chat;
+    parameters->messageId = message;
+
+    return parameters;
+}
+
+boost::property_tree::ptree SimpleTgBot::SendRequest(const TgBot::Url& url, const std::vector<TgBot::HttpReqArg>& args)const {
+    std::istringstream stream(getApi()._httpClient.makeRequest(url, args));
+    boost::property_tree::ptree tree;
+    boost::property_tree::read_json(stream, tree);
+
+    // Same exception tgbot's api throws, callers and stale file id retries don't tell the two paths apart
+    if(!tree.get<bool>("ok", false))
+        throw TgBot::TgException(tree.get<std::string>("description", "Unknown error"), static_cast<TgBot::TgException::ErrorCode>(tree.get<std::size_t>("error_code", 0)));
+
+    return std::move(tree.get_child("result"));
+}
+
+TgBot::Message::Ptr SimpleTgBot::SendMessage(std::int64_t chat, std::int32_t topic, std::string&& message, TgBot::GenericReply::Ptr reply, std::int64_t reply_message, bool silent) {
     if (!message.size()) {
         Log("Can't send empty messages");
         return nullptr;
     }
 
+    // Keeps capacity between sends on this thread
+    thread_local std::vector<TgBot::HttpReqArg> args;
+    args.clear();
+
     TgBot::Message::Ptr result = nullptr;
 
     try {
-        TgBot::LinkPreviewOptions::Ptr link_preview(new TgBot::LinkPreviewOptions());
-        link_preview->isDisabled = DisableWebpagePreview;
-
-        TgBot::ReplyParameters::Ptr reply_params(new TgBot::ReplyParameters());
-        reply_params->chatId = chat;
-        reply_params->messageId = reply_message;
-
-        result = getApi().sendMessage(chat, message, link_preview, reply_params, reply, ParseMode, silent, {}, topic);
+        args.emplace_back("chat_id", chat);
+        args.emplace_back("text", std::string());
+        args.back().value = std::move(message);
+        args.emplace_back("parse_mode", ParseMode);
+
+        if(DisableWebpagePreview)
+            args.emplace_back("link_preview_options", "{\"is_disabled\":true}");
+        if(topic)
+            args.emplace_back("message_thread_id", topic);
+        if(reply_message)
+            args.emplace_back("reply_parameters", Format("{\"message_id\":%,\"chat_id\":%}", reply_message, chat));
+        if(reply)
+            args.emplace_back("reply_markup", GetParser().parseGenericReply(reply));
+        if(silent)
+            args.emplace_back("disable_notification", silent);
+
+        result = GetParser().parseJsonAndGetMessage(SendRequest(m_SendMessageUrl, args));
     }
     catch (const std::exception& exception) {
         auto chat_ptr = getApi().getChat(chat);
@@ -177,6 +479,21 @@ TgBot::Message::Ptr SimpleTgBot::SendMessage(std::int64_t chat, std::int32_t top
     return result;
 }
 
+std::vector<TgBot::Message::Ptr> SimpleTgBot::SendLongMessage(std::int64_t chat, std::int32_t topic, const std::string& html, std::int64_t reply_message, bool silent) {
+    std::vector<TgBot::Message::Ptr> messages;
+
+    for (std::string &part : SimpleTgHtmlBuilder::SplitMessage(html)) {
+        TgBot::Message::Ptr message = SendMessage(chat, topic, std::move(part), nullptr, messages.size() ? 0 : reply_message, silent);
+
+        if(!message)
+            break;
+
+        messages.push_back(message);
+    }
+
+    return messages;
+}
+
 TgBot::Message::Ptr SimpleTgBot::SendMessage(TgBot::Message::Ptr source, const std::string& message, bool reply, bool silent){ 
     if(!source)
         return nullptr; 
@@ -192,12 +509,35 @@ TgBot::Message::Ptr SimpleTgBot::SendKeyboard(std::int64_t chat, std::int32_t to
     return SendMessage(chat, topic, message, ToInlineKeyboardMarkup(keyboard), reply_message);
 }
 
+TgBot::Message::Ptr SimpleTgBot::SendKeyboard(std::int64_t chat, std::int32_t topic, const std::string& message, const PaginatedKeyboard& keyboard, std::size_t page, std::int64_t reply_message) {
+    return SendKeyboard(chat, topic, message, keyboard.Page(page), reply_message);
+}
+
+bool SimpleTgBot::HandlePageFlip(TgBot::CallbackQuery::Ptr query, const PaginatedKeyboard& keyboard) {
+    // Page counter, nothing to flip
+    if (query->data.size() == keyboard.Id().size() + 1 && query->data.compare(0, keyboard.Id().size(), keyboard.Id()) == 0 && query->data.back() == '|') {
+        AnswerCallbackQuery(query->id);
+        return true;
+    }
+
+    std::optional<std::size_t> page = keyboard.ParsePage(query->data);
+
+    if(!page)
+        return false;
+
+    if(query->message)
+        EditKeyboard(query->message->chat->id, query->message->messageId, keyboard.Page(*page));
+
+    AnswerCallbackQuery(query->id);
+    return true;
+}
+
 TgBot::Message::Ptr SimpleTgBot::SendPhoto(std::int64_t chat, std::int32_t topic, const std::string& text, TgBot::InputFile::Ptr photo, std::int64_t reply_message){
     try {
-        TgBot::ReplyParameters::Ptr reply_params(new TgBot::ReplyParameters());
-        reply_params->chatId = chat;
-        reply_params->messageId = reply_message;
-	    return getApi().sendPhoto(chat, photo, text, reply_params, nullptr, ParseMode, false, {}, false, false, topic);
+        TgBot::ReplyParameters::Ptr reply_params = GetReplyParameters(chat, reply_message);
+        return SendMedia(photo, "photo", [&](const boost::variant<TgBot::InputFile::Ptr, std::string> &media) {
+	        return getApi().sendPhoto(chat, media, text, reply_params, nullptr, ParseMode, false, {}, false, false, topic);
+        });
     }catch (const std::exception& exception) {
         auto chat_ptr = getApi().getChat(chat);
         std::string chat_name = chat_ptr->username.size() ? chat_ptr->username : chat_ptr->title;
@@ -207,6 +547,70 @@ TgBot::Message::Ptr SimpleTgBot::SendPhoto(std::int64_t chat, std::int32_t topic
     return nullptr;
 }
 
+static std::string UploadedFileId(TgBot::Message::Ptr message) {
+    if(!message)
+        return {};
+
+    if(message->photo.size())
+        return message->photo.back()->fileId;
+    if(message->animation)
+        return message->animation->fileId;
+    if(message->video)
+        return message->video->fileId;
+    if(message->audio)
+        return message->audio->fileId;
+    if(message->document)
+        return message->document->fileId;
+
+    return {};
+}
+
+// Only errors about the file id itself justify an upload, "file is too big" and the like would fail again
+static bool IsStaleFileId(const std::exception& exception) {
+    const std::string_view what = exception.what();
+
+    return what.find("wrong file identifier") != std::string_view::npos
+        || what.find("wrong remote file identifier") != std::string_view::npos
+        || what.find("FILE_REFERENCE_") != std::string_view::npos;
+}
+
+// File ids are valid for the bot that uploaded the file only, bots sharing a cache get keys of their own
+static std::uint64_t BotSeed(const std::string& token) {
+    return SimpleTgUploadCache::Hash(std::string_view(token).substr(0, token.find(':')));
+}
+
+// File name is part of the key, documents keep the name they were first uploaded with
+static std::uint64_t MediaHash(const TgBot::InputFile& file, const char* kind, std::uint64_t bot) {
+    return SimpleTgUploadCache::Hash(file.data, SimpleTgUploadCache::Hash(file.fileName, SimpleTgUploadCache::Hash(kind, bot)));
+}
+
+TgBot::Message::Ptr SimpleTgBot::SendMedia(TgBot::InputFile::Ptr file, const char* kind, const MediaSender& send) {
+    if(!m_UploadCache || !file || !file->data.size())
+        return send(file);
+
+    const std::uint64_t hash = MediaHash(*file, kind, BotSeed(getToken()));
+
+    if (auto file_id = m_UploadCache->Find(hash)) {
+        try {
+            return send(*file_id);
+        } catch (const TgBot::TgException& exception) {
+            if(!IsStaleFileId(exception))
+                throw;
+
+            Log("Cached % % was rejected, uploading again: %", kind, *file_id, exception.what());
+            m_UploadCache->Erase(hash);
+        }
+    }
+
+    TgBot::Message::Ptr message = send(file);
+    std::string file_id = UploadedFileId(message);
+
+    if(file_id.size())
+        m_UploadCache->Insert(hash, std::move(file_id));
+
+    return message;
+}
+
 TgBot::Message::Ptr SimpleTgBot::SendPhoto(TgBot::Message::Ptr source, const std::string& text, TgBot::InputFile::Ptr photo){
     return SendPhoto(source->chat->id, source->isTopicMessage ? source->messageThreadId : 0, text, photo);
 }
@@ -217,10 +621,10 @@ TgBot::Message::Ptr SimpleTgBot::ReplyPhoto(TgBot::Message::Ptr source, const st
 
 TgBot::Message::Ptr SimpleTgBot::SendFile(std::int64_t chat, std::int32_t topic, const std::string& text, TgBot::InputFile::Ptr file, std::int64_t reply_message) {
     try {
-        TgBot::ReplyParameters::Ptr reply_params(new TgBot::ReplyParameters());
-        reply_params->chatId = chat;
-        reply_params->messageId = reply_message;
-	    return getApi().sendDocument(chat, file, file->fileName, text, reply_params, nullptr, ParseMode, false, {}, false, false, topic);
+        TgBot::ReplyParameters::Ptr reply_params = GetReplyParameters(chat, reply_message);
+        return SendMedia(file, "document", [&](const boost::variant<TgBot::InputFile::Ptr, std::string> &media) {
+	        return getApi().sendDocument(chat, media, file->fileName, text, reply_params, nullptr, ParseMode, false, {}, false, false, topic);
+        });
     }catch (const std::exception& exception) {
         auto chat_ptr = getApi().getChat(chat);
         std::string chat_name = chat_ptr->username.size() ? chat_ptr->username : chat_ptr->title;
@@ -239,6 +643,175 @@ TgBot::Message::Ptr SimpleTgBot::ReplyFile(TgBot::Message::Ptr source, const std
     return SendFile(source->chat->id, source->isTopicMessage ? source->messageThreadId : 0, text, file, source->messageId);
 }
 
+static constexpr std::size_t MediaGroupLimit = 10;
+
+struct MediaGroupChunk {
+    std::vector<TgBot::HttpReqArg> Args;
+    // Item index and hash of attached files, to cache file ids they get
+    std::vector<std::pair<std::size_t, std::uint64_t>> Uploads;
+    // Hashes of items sent by cached file id
+    std::vector<std::uint64_t> Cached;
+};
+
+static MediaGroupChunk PrepareMediaGroupChunk(const MediaGroupItem* items, std::size_t count, std::int64_t chat, std::int32_t topic, std::int64_t reply_message, SimpleTgUploadCache* cache, std::uint64_t bot, const char* parse_mode) {
+    MediaGroupChunk chunk;
+    boost::json::array media;
+
+    for (std::size_t i = 0; i < count; i++) {
+        const MediaGroupItem &item = items[i];
+        const char *kind = item.Document ? "document" : "photo";
+
+        boost::json::object entry;
+        entry["type"] = kind;
+
+        const std::uint64_t hash = cache && item.File->data.size() ? MediaHash(*item.File, kind, bot) : 0;
+        std::optional<std::string> file_id = hash ? cache->Find(hash) : std::nullopt;
+
+        if (file_id) {
+            entry["media"] = *file_id;
+            chunk.Cached.push_back(hash);
+        } else {
+            std::string name = Format("file%", i);
+            entry["media"] = "attach://" + name;
+            chunk.Args.emplace_back(name, item.File->data, true, item.File->mimeType, item.File->fileName);
+
+            if(hash)
+                chunk.Uploads.emplace_back(i, hash);
+        }
+
+        if (item.Caption.size()) {
+            entry["caption"] = item.Caption;
+            entry["parse_mode"] = parse_mode;
+        }
+
+        media.push_back(std::move(entry));
+    }
+
+    chunk.Args.emplace_back("chat_id", chat);
+    chunk.Args.emplace_back("media", boost::json::serialize(media));
+
+    if(topic)
+        chunk.Args.emplace_back("message_thread_id", topic);
+
+    if(reply_message)
+        chunk.Args.emplace_back("reply_parameters", boost::json::serialize(boost::json::object{{"chat_id", chat}, {"message_id", reply_message}}));
+
+    return chunk;
+}
+
+std::vector<TgBot::Message::Ptr> SimpleTgBot::SendMediaGroup(std::int64_t chat, std::int32_t topic, const std::vector<MediaGroupItem>& media, std::int64_t reply_message) {
+    const bool missing_file = std::any_of(media.begin(), media.end(), [](const MediaGroupItem &item) {
+        return !item.File;
+    });
+
+    if (missing_file) {
+        Log("Media group for chat % has an item without a file, nothing sent", chat);
+        return {};
+    }
+
+    // Runs of the same kind, split evenly so no chunk ends up with a lone item
+    std::vector<std::pair<std::size_t, std::size_t>> chunks;
+
+    for (std::size_t begin = 0; begin < media.size();) {
+        std::size_t end = begin;
+        while(end < media.size() && media[end].Document == media[begin].Document)
+            end++;
+
+        const std::size_t run = end - begin;
+        const std::size_t count = (run + MediaGroupLimit - 1) / MediaGroupLimit;
+
+        for (std::size_t i = 0; i < count; i++)
+            chunks.emplace_back(begin + run * i / count, begin + run * (i + 1) / count);
+
+        begin = end;
+    }
+
+    auto prepare = [&chunks, &media, chat, topic, reply_message, bot = BotSeed(getToken())](std::size_t index, SimpleTgUploadCache *cache) {
+        const auto [begin, end] = chunks[index];
+        return PrepareMediaGroupChunk(media.data() + begin, end - begin, chat, topic, reply_message, cache, bot, ParseMode);
+    };
+
+    auto send = [&](const MediaGroupChunk &chunk) {
+        return GetParser().parseJsonAndGetArray<TgBot::Message>(&TgBot::TgTypeParser::parseJsonAndGetMessage, SendRequest(m_SendMediaGroupUrl, chunk.Args));
+    };
+
+    std::vector<TgBot::Message::Ptr> result;
+    std::future<MediaGroupChunk> next;
+
+    for (std::size_t index = 0; index < chunks.size(); index++) {
+        const auto [begin, end] = chunks[index];
+
+        // Telegram wants at least two items in a group
+        if (end - begin == 1) {
+            const MediaGroupItem &item = media[begin];
+            TgBot::Message::Ptr message = item.Document
+                ? SendFile(chat, topic, item.Caption, item.File, reply_message)
+                : SendPhoto(chat, topic, item.Caption, item.File, reply_message);
+
+            if(!message)
+                break;
+
+            result.push_back(message);
+            continue;
+        }
+
+        MediaGroupChunk chunk = next.valid() ? next.get() : prepare(index, m_UploadCache);
+
+        // Chunks are sent one by one to keep their order in chat, building the next request overlaps with this upload
+        if(index + 1 < chunks.size() && chunks[index + 1].second - chunks[index + 1].first > 1)
+            next = std::async(std::launch::async, prepare, index + 1, m_UploadCache);
+
+        std::vector<TgBot::Message::Ptr> messages;
+
+        try {
+            try {
+                messages = send(chunk);
+            } catch (const std::exception& exception) {
+                if(!chunk.Cached.size() || !IsStaleFileId(exception))
+                    throw;
+
+                Log("Cached media of the group was rejected, uploading again: %", exception.what());
+
+                for (std::uint64_t hash : chunk.Cached)
+                    m_UploadCache->Erase(hash);
+
+                // Erased entries miss now, so everything is uploaded and new file ids are recorded as Uploads
+                chunk = prepare(index, m_UploadCache);
+                messages = send(chunk);
+            }
+        } catch (const std::exception& exception) {
+            Log("Failed to send media group in chat % reason %", chat, exception.what());
+            break;
+        }
+
+        for (const auto &[item, hash] : chunk.Uploads) {
+            if(item >= messages.size())
+                continue;
+
+            std::string file_id = UploadedFileId(messages[item]);
+
+            if(file_id.size())
+                m_UploadCache->Insert(hash, std::move(file_id));
+        }
+
+        result.insert(result.end(), messages.begin(), messages.end());
+    }
+
+    // Let the prepared chunk finish before media it points to can go away
+    if(next.valid())
+        next.wait();
+
+    return result;
+}
+
+std::vector<TgBot::Message::Ptr> SimpleTgBot::SendMediaGroup(TgBot::Message::Ptr source, const std::vector<MediaGroupItem>& media) {
+    return SendMediaGroup(source->chat->id, source->isTopicMessage ? source->messageThreadId : 0, media);
+}
+
+std::vector<TgBot::Message::Ptr> SimpleTgBot::ReplyMediaGroup(TgBot::Message::Ptr source, const std::vector<MediaGroupItem>& media) {
+    return SendMediaGroup(source->chat->id, source->isTopicMessage ? source->messageThreadId : 0, media, source->messageId);
+}
+
 
 TgBot::Message::Ptr SimpleTgBot::EditMessage(TgBot::Message::Ptr message, const std::string& text, TgBot::InlineKeyboardMarkup::Ptr reply) {
     TgBot::Message::Ptr result = message;
@@ -271,9 +844,7 @@ TgBot::Message::Ptr SimpleTgBot::EditMessage(TgBot::Message::Ptr message, const
 
 TgBot::Message::Ptr SimpleTgBot::EditMessage(std::int64_t chat, std::int32_t message, const std::string& text, TgBot::InlineKeyboardMarkup::Ptr reply) {
     try{
-        TgBot::LinkPreviewOptions::Ptr link_preview(new TgBot::LinkPreviewOptions());
-        link_preview->isDisabled = DisableWebpagePreview;
-        return getApi().editMessageText(text, chat, message, "", ParseMode, link_preview, reply);
+        return getApi().editMessageText(text, chat, message, "", ParseMode, DisableWebpagePreview ? GetDisabledLinkPreviewOptions() : nullptr, reply);
     }
     catch (const std::exception& exception) {
         Log("Failed to edit message in chat '%'  reason %", chat, exception.what());
@@ -295,6 +866,191 @@ bool SimpleTgBot::AnswerCallbackQuery(const std::string& callbackQueryId, const
     return false;
 }
 
+void SimpleTgBot::WaitMessage(std::int64_t chat, std::int64_t user, std::chrono::steady_clock::duration timeout, MessageWaiter waiter) {
+    const std::pair<std::int64_t, std::int64_t> key = {chat, user};
+
+    MessageWaiter replaced;
+    {
+        std::lock_guard<std::mutex> lock(m_WaitsLock);
+
+        auto &wait = m_MessageWaits[key];
+        replaced = std::move(wait.Waiter);
+
+        if(wait.Timer)
+            m_Timers.Cancel(wait.Timer);
+
+        wait.Deadline = std::chrono::steady_clock::now() + timeout;
+        wait.Timer = m_Timers.ScheduleAt(wait.Deadline, [this, key]() {
+            boost::asio::post(m_Workers, [this, key]() {
+                ExpireMessageWait(key);
+            });
+        });
+        wait.Waiter = std::move(waiter);
+    }
+
+    if(replaced)
+        replaced(nullptr);
+}
+
+void SimpleTgBot::WaitCallbackQuery(std::int64_t chat, std::int32_t message, std::chrono::steady_clock::duration timeout, CallbackQueryWaiter waiter, std::int64_t user) {
+    const std::pair<std::int64_t, std::int32_t> key = {chat, message};
+
+    CallbackQueryWaiter replaced;
+    {
+        std::lock_guard<std::mutex> lock(m_WaitsLock);
+
+        auto &wait = m_CallbackQueryWaits[key];
+        replaced = std::move(wait.Waiter);
+
+        if(wait.Timer)
+            m_Timers.Cancel(wait.Timer);
+
+        wait.Deadline = std::chrono::steady_clock::now() + timeout;
+        wait.Timer = m_Timers.ScheduleAt(wait.Deadline, [this, key]() {
+            boost::asio::post(m_Workers, [this, key]() {
+                ExpireCallbackQueryWait(key);
+            });
+        });
+        wait.Waiter = std::move(waiter);
+        wait.User = user;
+    }
+
+    if(replaced)
+        replaced(nullptr);
+}
+
+SimpleTgBot::MessageAwaiter SimpleTgBot::NextMessage(std::int64_t chat, std::int64_t user, std::chrono::steady_clock::duration timeout) {
+    return {this, chat, user, timeout, nullptr};
+}
+
+SimpleTgBot::MessageAwaiter SimpleTgBot::NextMessage(TgBot::Message::Ptr source, std::chrono::steady_clock::duration timeout) {
+    return NextMessage(source->chat->id, source->from ? source->from->id : 0, timeout);
+}
+
+SimpleTgBot::CallbackQueryAwaiter SimpleTgBot::NextCallback(TgBot::Message::Ptr message, std::chrono::steady_clock::duration timeout, std::int64_t user) {
+    return {this, message->chat->id, message->messageId, timeout, nullptr, user};
+}
+
+std::size_t SimpleTgBot::WaitsCount() {
+    std::lock_guard<std::mutex> lock(m_WaitsLock);
+
+    return m_MessageWaits.size() + m_CallbackQueryWaits.size();
+}
+
+SimpleTgTimerWheel::TimerId SimpleTgBot::ScheduleAfter(std::chrono::steady_clock::duration delay, std::function<void()> callback) {
+    return ScheduleAt(std::chrono::steady_clock::now() + delay, std::move(callback));
+}
+
+SimpleTgTimerWheel::TimerId SimpleTgBot::ScheduleAt(std::chrono::steady_clock::time_point time, std::function<void()> callback) {
+    return m_Timers.ScheduleAt(time, [this, callback = std::move(callback)]() {
+        try {
+            callback();
+        } catch (const std::exception& e) {
+            Log("Timer callback failed: %", e.what());
+        }
+    });
+}
+
+bool SimpleTgBot::CancelTimer(SimpleTgTimerWheel::TimerId timer) {
+    return m_Timers.Cancel(timer);
+}
+
+bool SimpleTgBot::ResumeMessageWait(TgBot::Message::Ptr message) {
+    if(!message->from)
+        return false;
+
+    MessageWaiter waiter;
+    {
+        std::lock_guard<std::mutex> lock(m_WaitsLock);
+
+        auto it = m_MessageWaits.find({message->chat->id, message->from->id});
+
+        if(it == m_MessageWaits.end())
+            return false;
+
+        m_Timers.Cancel(it->second.Timer);
+        waiter = std::move(it->second.Waiter);
+        m_MessageWaits.erase(it);
+    }
+
+    waiter(message);
+    return true;
+}
+
+bool SimpleTgBot::ResumeCallbackQueryWait(TgBot::CallbackQuery::Ptr query) {
+    if(!query->message || !query->from)
+        return false;
+
+    CallbackQueryWaiter waiter;
+    {
+        std::lock_guard<std::mutex> lock(m_WaitsLock);
+
+        auto it = m_CallbackQueryWaits.find({query->message->chat->id, query->message->messageId});
+
+        if(it == m_CallbackQueryWaits.end())
+            return false;
+
+        if(it->second.User && it->second.User != query->from->id)
+            return false;
+
+        m_Timers.Cancel(it->second.Timer);
+        waiter = std::move(it->second.Waiter);
+        m_CallbackQueryWaits.erase(it);
+    }
+
+    waiter(query);
+    return true;
+}
+
+bool SimpleTgBot::IsConsumed(const std::shared_ptr<const void>& update)const {
+    // Owner comparison, control block of a consumed update stays allocated while weak pointer refers to it
+    return !m_ConsumedUpdate.owner_before(update) && !update.owner_before(m_ConsumedUpdate);
+}
+
+void SimpleTgBot::ExpireMessageWait(std::pair<std::int64_t, std::int64_t> key) {
+    MessageWaiter waiter;
+    {
+        std::lock_guard<std::mutex> lock(m_WaitsLock);
+
+        auto it = m_MessageWaits.find(key);
+
+        // Wait was resumed or replaced by a newer one while this timer was firing
+        if(it == m_MessageWaits.end() || it->second.Deadline > std::chrono::steady_clock::now())
+            return;
+
+        waiter = std::move(it->second.Waiter);
+        m_MessageWaits.erase(it);
+    }
+
+    try {
+        waiter(nullptr);
+    } catch (const std::exception& e) {
+        Log("Expired wait handler failed: %", e.what());
+    }
+}
+
+void SimpleTgBot::ExpireCallbackQueryWait(std::pair<std::int64_t, std::int32_t> key) {
+    CallbackQueryWaiter waiter;
+    {
+        std::lock_guard<std::mutex> lock(m_WaitsLock);
+
+        auto it = m_CallbackQueryWaits.find(key);
+
+        // Wait was resumed or replaced by a newer one while this timer was firing
+        if(it == m_CallbackQueryWaits.end() || it->second.Deadline > std::chrono::steady_clock::now())
+            return;
+
+        waiter = std::move(it->second.Waiter);
+        m_CallbackQueryWaits.erase(it);
+    }
+
+    try {
+        waiter(nullptr);
+    } catch (const std::exception& e) {
+        Log("Expired wait handler failed: %", e.what());
+    }
+}
+
 bool SimpleTgBot::DeleteMessage(TgBot::Message::Ptr message) {
     if (!message)
         return false;
@@ -354,23 +1110,27 @@ void SimpleTgBot::BroadcastCommand(const std::string& command, TgBot::Message::P
 
     const auto &handler = it->second;
 
-    handler(message);
+    RunHandler(command, message->chat->id, handler, message);
 }
 
 void SimpleTgBot::OnNonCommandMessage(MessageHandler handler){
     getEvents().onNonCommandMessage([this, handler](TgBot::Message::Ptr message) {
+        if(IsConsumed(message))
+            return;
         if(message->from && !IsLegit(message->chat->id, message->from->id))
             return;
-        handler(message);
+        RunHandler("message", message->chat->id, handler, message);
     });
 }
 
 void SimpleTgBot::OnCallbackQuery(CallbackQueryHandler handler){
     getEvents().onCallbackQuery([this, handler](TgBot::CallbackQuery::Ptr query) {
+        if(IsConsumed(query))
+            return;
         std::int64_t chat_id = query->message ? query->message->chat->id : 0;
         if(query->from && !IsLegit(chat_id, query->from->id))
             return;
-        handler(query);
+        RunHandler("callback_query", chat_id, handler, query);
     });
 }
 
@@ -378,15 +1138,126 @@ void SimpleTgBot::OnMyChatMember(ChatMemberStatusHandler chat_member){
     getEvents().onMyChatMember([this, chat_member](TgBot::ChatMemberUpdated::Ptr update) {
         if(update->from && !IsLegit(update->chat->id, update->from->id))
             return;
-        chat_member(update);
+        RunHandler("my_chat_member", update->chat->id, chat_member, update);
     });
 }
 
+void SimpleTgBot::OnInlineQuery(InlineQueryHandler handler, std::chrono::steady_clock::duration debounce, std::size_t cache_capacity) {
+    const bool registered = m_InlineQueryHandler != nullptr;
+
+    m_InlineQueryHandler = std::move(handler);
+    m_InlineQueryDebounce = debounce;
+    m_InlineResults.SetCapacity(cache_capacity);
+
+    if(registered)
+        return;
+
+    getEvents().onInlineQuery([this](TgBot::InlineQuery::Ptr query) {
+        if(query->from && !IsLegit(0, query->from->id))
+            return;
+        HandleInlineQuery(query);
+    });
+}
+
+SimpleTgInlineResultCache& SimpleTgBot::GetInlineResultCache() {
+    return m_InlineResults;
+}
+
+void SimpleTgBot::HandleInlineQuery(TgBot::InlineQuery::Ptr query) {
+    const std::int64_t user = query->from ? query->from->id : 0;
+
+    if (auto answer = m_InlineResults.Find(*query)) {
+        {
+            std::lock_guard<std::mutex> lock(m_InlineQueriesLock);
+
+            // Answered query supersedes the one still waiting for debounce
+            auto it = m_PendingInlineQueries.find(user);
+
+            if (it != m_PendingInlineQueries.end()) {
+                if(it->second.Timer)
+                    m_Timers.Cancel(it->second.Timer);
+                m_PendingInlineQueries.erase(it);
+            }
+        }
+
+        AnswerInlineQuery(query, *answer);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_InlineQueriesLock);
+
+        auto &pending = m_PendingInlineQueries[user];
+
+        // Superseded query is dropped unanswered, user already sees the newer one
+        if(pending.Timer)
+            m_Timers.Cancel(pending.Timer);
+
+        pending.Query = query;
+        pending.Timer = 0;
+
+        if (m_InlineQueryDebounce.count() > 0) {
+            pending.Timer = m_Timers.ScheduleAfter(m_InlineQueryDebounce, [this, user]() {
+                boost::asio::post(m_Workers, [this, user]() {
+                    RunInlineQuery(user);
+                });
+            });
+            return;
+        }
+    }
+
+    RunInlineQuery(user);
+}
+
+void SimpleTgBot::RunInlineQuery(std::int64_t user) {
+    TgBot::InlineQuery::Ptr query;
+    {
+        std::lock_guard<std::mutex> lock(m_InlineQueriesLock);
+
+        auto it = m_PendingInlineQueries.find(user);
+
+        if(it == m_PendingInlineQueries.end())
+            return;
+
+        query = std::move(it->second.Query);
+        m_PendingInlineQueries.erase(it);
+    }
+
+    // Same search of another user may have been answered while this one waited
+    SimpleTgInlineResultCache::AnswerPtr answer = m_InlineResults.Find(*query);
+
+    if (!answer) {
+        InlineQueryAnswer fresh;
+
+        try {
+            RunHandler("inline_query", 0, [&](TgBot::InlineQuery::Ptr query) {
+                fresh = m_InlineQueryHandler(query);
+            }, query);
+        } catch (const std::exception& e) {
+            Log("Caught exception on inline query '%': %", query->query, e.what());
+            return;
+        }
+
+        answer = std::make_shared<const InlineQueryAnswer>(std::move(fresh));
+        m_InlineResults.Insert(*query, answer);
+    }
+
+    AnswerInlineQuery(query, *answer);
+}
+
+void SimpleTgBot::AnswerInlineQuery(TgBot::InlineQuery::Ptr query, const InlineQueryAnswer& answer) {
+    try {
+        getApi().answerInlineQuery(query->id, answer.Results, answer.CacheTime, answer.Personal, answer.NextOffset);
+    } catch (const std::exception& e) {
+        Log("Failed to answer inline query '%' reason %", query->query, e.what());
+    }
+}
+
 void SimpleTgBot::OnOtherChatMember(ChatMemberStatusHandler chat_member) {
     getEvents().onChatMember([this, chat_member](TgBot::ChatMemberUpdated::Ptr update) {
         if(update->from && !IsLegit(update->chat->id, update->from->id))
             return;
-        chat_member(update);
+        RunHandler("chat_member", update->chat->id, chat_member, update);
     });
 }
 
@@ -445,7 +1316,7 @@ std::string SimpleTgBot::ParseCommand(TgBot::Message::Ptr message){
     if (at != std::string::npos) {
         std::string command_bot_name = command_name.substr(at + 1);
         
-        if(command_bot_name != m_Username)
+        if(command_bot_name != GetUsername())
             return {};
     }
 
@@ -511,12 +1382,15 @@ void SimplePollBot::LongPollIteration() {
 }
 
 
-FastLongPoll::FastLongPoll(const TgBot::Api* api, const TgBot::EventHandler* eventHandler, std::int32_t limit, std::int32_t timeout, std::shared_ptr<std::vector<std::string>> allowUpdates)
+FastLongPoll::FastLongPoll(const TgBot::Api* api, const TgBot::EventHandler* eventHandler, std::int32_t limit, std::int32_t timeout, std::shared_ptr<std::vector<std::string>> allowUpdates, bool skipPendingUpdates)
     : _api(api), _eventHandler(eventHandler), _limit(limit), _timeout(timeout)
     , _allowUpdates(std::move(allowUpdates)) {
 
     const_cast<TgBot::HttpClient&>(_api->_httpClient)._timeout = _timeout + 5;
 
+    if (!skipPendingUpdates)
+        return;
+
     for (TgBot::Update::Ptr& item : _api->getUpdates(-1, 1)) {
         if (item->updateId >= _lastUpdateId) {
             _lastUpdateId = item->updateId + 1;
@@ -524,23 +1398,181 @@ FastLongPoll::FastLongPoll(const TgBot::Api* api, const TgBot::EventHandler* eve
     }
 }
 
-FastLongPoll::FastLongPoll(const TgBot::Bot& bot, std::int32_t limit, std::int32_t timeout, const std::shared_ptr<std::vector<std::string>>& allowUpdates)
-    : FastLongPoll(&bot.getApi(), &bot.getEventHandler(), limit, timeout, allowUpdates) {
+FastLongPoll::FastLongPoll(const TgBot::Bot& bot, std::int32_t limit, std::int32_t timeout, const std::shared_ptr<std::vector<std::string>>& allowUpdates, bool skipPendingUpdates)
+    : FastLongPoll(&bot.getApi(), &bot.getEventHandler(), limit, timeout, allowUpdates, skipPendingUpdates) {
 }
 
 void FastLongPoll::start() {
-    _updates = _api->getUpdates(_lastUpdateId, _limit, _timeout, _allowUpdates);
+    {
+        // Nested outbound span of the api call is the network part, the rest is parsing
+        SimpleTgTracer::Span span(_tracer, "receive", "poll");
+        // Telegram answers at once while updates are pending, so timeout only matters once the backlog is drained
+        _updates = _api->getUpdates(_lastUpdateId, _catchingUp ? SimpleTgBot::MaxUpdatesLimit : _limit, _timeout, _allowUpdates);
+    }
+
+    if (_metrics)
+        _metrics->RecordUpdateBatch(_updates.size());
+
+    _commitPerBatch = _catchingUp;
+
+    // Partial batch means the backlog is drained
+    if (_catchingUp && _updates.size() < static_cast<std::size_t>(SimpleTgBot::MaxUpdatesLimit))
+        _catchingUp = false;
+
+    // Idle poll is the cheap moment to persist offsets batched so far
+    if (_checkpoint && _updates.empty())
+        _checkpoint->Flush();
 
     handleUpdates();
 }
 
+void FastLongPoll::setMetrics(SimpleTgMetrics* metrics) {
+    _metrics = metrics;
+}
+
+void FastLongPoll::setTracer(SimpleTgTracer* tracer) {
+    _tracer = tracer;
+}
+
+void FastLongPoll::setCheckpoint(SimpleTgOffsetCheckpoint* checkpoint, bool catchUp) {
+    _checkpoint = checkpoint;
+    _catchingUp = false;
+
+    if (!_checkpoint)
+        return;
+
+    std::optional<std::int32_t> offset = _checkpoint->Offset();
+
+    if (!offset)
+        return;
+
+    _lastUpdateId = *offset;
+    _catchingUp = catchUp;
+}
+
+void FastLongPoll::setAdmission(SimpleTgAdmission* admission, std::function<void(const std::string&)> log) {
+    _admission = admission;
+    _log = std::move(log);
+}
+
+std::int64_t SimpleTgBot::GetUpdateChatId(const TgBot::Update::Ptr& update) {
+    if (update->message)
+        return update->message->chat->id;
+    if (update->editedMessage)
+        return update->editedMessage->chat->id;
+    if (update->channelPost)
+        return update->channelPost->chat->id;
+    if (update->callbackQuery && update->callbackQuery->message)
+        return update->callbackQuery->message->chat->id;
+    if (update->myChatMember)
+        return update->myChatMember->chat->id;
+    if (update->chatMember)
+        return update->chatMember->chat->id;
+    return 0;
+}
+
+std::uint32_t SimpleTgBot::GetUpdateDate(const TgBot::Update::Ptr& update) {
+    if (update->message)
+        return update->message->date;
+    if (update->editedMessage)
+        return update->editedMessage->date;
+    if (update->channelPost)
+        return update->channelPost->date;
+    if (update->myChatMember)
+        return update->myChatMember->date;
+    if (update->chatMember)
+        return update->chatMember->date;
+    return 0;
+}
+
 void FastLongPoll::handleUpdates()
 {
-    for (TgBot::Update::Ptr& item : _updates) {
-        if (item->updateId >= _lastUpdateId) {
-            _lastUpdateId = item->updateId + 1;
+    const std::size_t received = _updates.size();
+    // Ids of the batch as admission got it, to tell what is left of it when a handler throws
+    std::vector<std::int32_t> admitted;
+
+    if (_admission && received) {
+        // Offset covers the whole batch, shed updates must not be fetched again
+        for (TgBot::Update::Ptr& item : _updates) {
+            if (item->updateId >= _lastUpdateId) {
+                _lastUpdateId = item->updateId + 1;
+            }
         }
-        _eventHandler->handleUpdate(item);
+
+        if (_redelivered.size()) {
+            _updates.erase(std::remove_if(_updates.begin(), _updates.end(), [this](const TgBot::Update::Ptr &item) {
+                return _redelivered.count(item->updateId) > 0;
+            }), _updates.end());
+        }
+
+        for (const TgBot::Update::Ptr& item : _updates)
+            admitted.push_back(item->updateId);
+
+        _admission->Admit(_updates);
+
+        std::optional<std::string> report = _admission->TakeReport();
+        if (report && _log)
+            _log(*report);
+    }
+
+    std::size_t dispatched = 0;
+
+    try {
+        for (; dispatched < _updates.size(); dispatched++) {
+            TgBot::Update::Ptr& item = _updates[dispatched];
+
+            if (!_admission && item->updateId >= _lastUpdateId) {
+                _lastUpdateId = item->updateId + 1;
+            }
+
+            if(_redelivered.count(item->updateId))
+                continue;
+
+            std::uint32_t date = _metrics ? SimpleTgBot::GetUpdateDate(item) : 0;
+            if (date)
+                _metrics->RecordPollLag(std::chrono::system_clock::now() - std::chrono::system_clock::from_time_t(date));
+
+            SimpleTgTracer::Span span(_tracer, "dispatch", "poll", _tracer ? SimpleTgBot::GetUpdateChatId(item) : 0);
+            _eventHandler->handleUpdate(item);
+
+            // Callbacks go first after admission, ids are no longer ascending and the batch is committed as a whole
+            if (_checkpoint && !_admission && !_commitPerBatch)
+                _checkpoint->Commit(item->updateId + 1);
+        }
+    } catch (...) {
+        // Callbacks went first, so updates left after the failed one need not follow the dispatched ones.
+        // Offset goes back to the lowest one left, everything else of the batch past it, the failed update
+        // included, is skipped when it comes again
+        if (_admission) {
+            std::unordered_set<std::int32_t> left;
+
+            for (std::size_t i = dispatched + 1; i < _updates.size(); i++) {
+                left.insert(_updates[i]->updateId);
+                _lastUpdateId = std::min(_lastUpdateId, _updates[i]->updateId);
+            }
+
+            for (std::int32_t id : admitted) {
+                if(id >= _lastUpdateId && !left.count(id))
+                    _redelivered.insert(id);
+            }
+        }
+
+        // Persisted offset must agree with the one the next poll starts from
+        if (_checkpoint && (_admission || _commitPerBatch))
+            _checkpoint->Commit(_lastUpdateId);
+
+        throw;
+    }
+
+    if (_checkpoint && (_admission || _commitPerBatch) && received)
+        _checkpoint->Commit(_lastUpdateId);
+
+    // Offset is past them, they can't come again
+    for (auto it = _redelivered.begin(); it != _redelivered.end();) {
+        if(*it < _lastUpdateId)
+            it = _redelivered.erase(it);
+        else
+            ++it;
     }
 }
 
@@ -0,0 +1,115 @@
+#include "simple/tg_checkpoint.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Data must be on disk before rename makes it visible, otherwise a crash can leave an empty checkpoint
+static bool WriteDurably(const std::string &path, const std::string &content) {
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+
+    if(!file)
+        return false;
+
+    bool written = std::fwrite(content.data(), 1, content.size(), file) == content.size() && std::fflush(file) == 0;
+
+#ifdef _WIN32
+    written = written && _commit(_fileno(file)) == 0;
+#else
+    written = written && fsync(fileno(file)) == 0;
+#endif
+
+    return std::fclose(file) == 0 && written;
+}
+
+// Rename itself is durable only once the directory entry is synced, Windows has no equivalent for directories
+static void SyncDirectory(const std::filesystem::path &path) {
+#ifndef _WIN32
+    std::filesystem::path directory = path.parent_path();
+
+    int descriptor = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+
+    if(descriptor < 0)
+        return;
+
+    fsync(descriptor);
+    close(descriptor);
+#else
+    (void)path;
+#endif
+}
+
+SimpleTgOffsetCheckpoint::SimpleTgOffsetCheckpoint(std::string path, std::size_t batch_size, std::chrono::steady_clock::duration interval):
+    m_Path(std::move(path)),
+    m_BatchSize(batch_size ? batch_size : 1),
+    m_Interval(interval)
+{
+    std::ifstream file(m_Path);
+    std::int32_t offset = 0;
+
+    if (file >> offset) {
+        m_Offset = offset;
+        m_WrittenOffset = offset;
+    }
+}
+
+SimpleTgOffsetCheckpoint::~SimpleTgOffsetCheckpoint() {
+    Flush();
+}
+
+std::optional<std::int32_t> SimpleTgOffsetCheckpoint::Offset()const {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    return m_Offset;
+}
+
+void SimpleTgOffsetCheckpoint::Commit(std::int32_t offset) {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    if(m_Offset && *m_Offset >= offset)
+        return;
+
+    m_Offset = offset;
+    m_PendingCommits++;
+
+    if(m_PendingCommits < m_BatchSize && std::chrono::steady_clock::now() - m_LastWrite < m_Interval)
+        return;
+
+    Write(offset);
+}
+
+bool SimpleTgOffsetCheckpoint::Flush() {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    if(!m_Offset || *m_Offset == m_WrittenOffset)
+        return true;
+
+    return Write(*m_Offset);
+}
+
+bool SimpleTgOffsetCheckpoint::Write(std::int32_t offset) {
+    const std::string temporary = m_Path + ".tmp";
+
+    if(!WriteDurably(temporary, std::to_string(offset)))
+        return false;
+
+    std::error_code error;
+    std::filesystem::rename(temporary, m_Path, error);
+
+    if(error)
+        return false;
+
+    SyncDirectory(m_Path);
+
+    m_WrittenOffset = offset;
+    m_PendingCommits = 0;
+    m_LastWrite = std::chrono::steady_clock::now();
+
+    return true;
+}
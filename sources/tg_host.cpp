@@ -0,0 +1,658 @@
+#include "simple/tg_host.hpp"
+#include <charconv>
+#include <sstream>
+#include <boost/algorithm/string.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+struct ResponseHead {
+    std::size_t ContentLength = std::string::npos;
+    bool KeepAlive = true;
+    bool Chunked = false;
+    bool Malformed = false;
+};
+
+static ResponseHead ParseResponseHead(const std::string &head) {
+    ResponseHead result;
+
+    std::istringstream stream(head);
+    std::string line;
+
+    std::getline(stream, line);
+    if(boost::algorithm::starts_with(line, "HTTP/1.0"))
+        result.KeepAlive = false;
+
+    while (std::getline(stream, line)) {
+        std::size_t colon = line.find(':');
+
+        if(colon == std::string::npos)
+            continue;
+
+        std::string name = boost::algorithm::to_lower_copy(line.substr(0, colon));
+        std::string value = boost::algorithm::to_lower_copy(boost::algorithm::trim_copy(line.substr(colon + 1)));
+
+        // Parsed without exceptions, this runs inside asio completion handlers
+        if (name == "content-length") {
+            auto parsed = std::from_chars(value.data(), value.data() + value.size(), result.ContentLength);
+
+            if (parsed.ec != std::errc() || parsed.ptr != value.data() + value.size()) {
+                result.ContentLength = std::string::npos;
+                result.Malformed = true;
+            }
+        }
+        if(name == "connection")
+            result.KeepAlive = value != "close";
+        if(name == "transfer-encoding")
+            result.Chunked = value.find("chunked") != std::string::npos;
+    }
+
+    if(result.ContentLength == std::string::npos)
+        result.KeepAlive = false;
+
+    return result;
+}
+
+static std::string TakeBuffer(boost::asio::streambuf &buffer, std::size_t size) {
+    std::string result(boost::asio::buffers_begin(buffer.data()), boost::asio::buffers_begin(buffer.data()) + size);
+    buffer.consume(size);
+    return result;
+}
+
+static std::string UrlEncode(const std::string &text) {
+    static const char *Hex = "0123456789ABCDEF";
+
+    std::string result;
+    result.reserve(text.size() * 3);
+
+    for (unsigned char c : text) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            result.push_back(c);
+        } else {
+            result.push_back('%');
+            result.push_back(Hex[c >> 4]);
+            result.push_back(Hex[c & 15]);
+        }
+    }
+
+    return result;
+}
+
+struct Endpoint {
+    bool Tls = true;
+    std::string Host;
+    std::string Port;
+};
+
+// Url keeps the port in its host, e.g. "localhost:8081"
+static Endpoint ParseEndpoint(const TgBot::Url &url) {
+    Endpoint endpoint;
+
+    if(url.protocol == "http")
+        endpoint.Tls = false;
+    else if(url.protocol != "https")
+        throw std::invalid_argument("Unsupported protocol '" + url.protocol + "', only http and https are");
+
+    endpoint.Host = url.host;
+    endpoint.Port = endpoint.Tls ? "443" : "80";
+
+    // Bracketed ipv6 address has colons of its own
+    const std::size_t bracket = url.host.rfind(']');
+    const std::size_t colon = url.host.rfind(':');
+
+    if (colon != std::string::npos && (bracket == std::string::npos || colon > bracket)) {
+        endpoint.Host = url.host.substr(0, colon);
+        endpoint.Port = url.host.substr(colon + 1);
+    }
+
+    if(endpoint.Host.size() > 1 && endpoint.Host.front() == '[' && endpoint.Host.back() == ']')
+        endpoint.Host = endpoint.Host.substr(1, endpoint.Host.size() - 2);
+
+    return endpoint;
+}
+
+static std::string PoolKey(const TgBot::Url &url) {
+    return url.protocol + "://" + url.host;
+}
+
+static void ConfigureSslContext(boost::asio::ssl::context &context) {
+    context.set_default_verify_paths();
+    context.set_verify_mode(boost::asio::ssl::verify_peer);
+}
+
+struct SimpleTgPooledHttpClient::Connection {
+    boost::asio::io_context Context;
+    SimpleTgPooledHttpClient::Stream Stream;
+    boost::asio::steady_timer Timer;
+    // Plain http talks to the socket under the ssl stream directly
+    bool Tls;
+
+    Connection(boost::asio::ssl::context &ssl_context, bool tls):
+        Stream(Context, ssl_context),
+        Timer(Context),
+        Tls(tls)
+    {}
+
+    template<typename CallbackType>
+    void WithStream(const CallbackType &callback) {
+        if(Tls)
+            callback(Stream);
+        else
+            callback(Stream.next_layer());
+    }
+
+    // Runs one async operation to completion, socket is closed when it takes longer than timeout
+    template<typename StartType>
+    boost::system::error_code Run(std::chrono::seconds timeout, std::size_t &transferred, const StartType &start) {
+        boost::system::error_code result;
+        bool expired = false;
+
+        Timer.expires_after(timeout);
+        Timer.async_wait([this, &expired](boost::system::error_code error) {
+            if(error)
+                return;
+
+            expired = true;
+            boost::system::error_code ignored;
+            Stream.lowest_layer().close(ignored);
+        });
+
+        start([this, &result, &transferred](boost::system::error_code error, std::size_t size) {
+            result = error;
+            transferred = size;
+            Timer.cancel();
+        });
+
+        Context.restart();
+        Context.run();
+
+        return expired ? boost::system::error_code(boost::asio::error::timed_out) : result;
+    }
+};
+
+SimpleTgPooledHttpClient::SimpleTgPooledHttpClient(std::size_t max_idle):
+    m_SslContext(boost::asio::ssl::context::tls_client),
+    m_MaxIdle(max_idle)
+{
+    ConfigureSslContext(m_SslContext);
+}
+
+SimpleTgPooledHttpClient::~SimpleTgPooledHttpClient() = default;
+
+std::string SimpleTgPooledHttpClient::makeRequest(const TgBot::Url& url, const std::vector<TgBot::HttpReqArg>& args) const {
+    const std::string request = m_Parser.generateRequest(url, args, true);
+    const std::chrono::seconds timeout(std::max(_timeout, 1));
+    // Anything but reads may have been executed by the time connection dropped, sending it again duplicates it
+    const bool idempotent = boost::algorithm::starts_with(SimpleTgMetricsHttpClient::GetMethodName(url.path), "get");
+
+    for (;;) {
+        bool reused = false;
+        std::unique_ptr<Connection> connection = Acquire(url, timeout, reused);
+
+        boost::asio::streambuf buffer;
+        std::size_t transferred = 0;
+
+        boost::system::error_code error = connection->Run(timeout, transferred, [&](auto done) {
+            connection->WithStream([&](auto &stream) {
+                boost::asio::async_write(stream, boost::asio::buffer(request), done);
+            });
+        });
+
+        // Server is free to close idle keep-alive connection at any moment, request didn't reach it then
+        if(error && reused && error != boost::asio::error::timed_out)
+            continue;
+        if(error)
+            throw boost::system::system_error(error);
+
+        std::size_t head_size = 0;
+
+        error = connection->Run(timeout, head_size, [&](auto done) {
+            connection->WithStream([&](auto &stream) {
+                boost::asio::async_read_until(stream, buffer, "\r\n\r\n", done);
+            });
+        });
+
+        if(error && reused && idempotent && !buffer.size() && error != boost::asio::error::timed_out)
+            continue;
+        if(error)
+            throw boost::system::system_error(error);
+
+        ResponseHead head = ParseResponseHead(TakeBuffer(buffer, head_size));
+
+        if(head.Malformed)
+            throw std::runtime_error("Malformed response head");
+
+        if(head.Chunked)
+            throw std::runtime_error("Chunked responses are not supported");
+
+        if (head.ContentLength != std::string::npos) {
+            if (buffer.size() < head.ContentLength) {
+                error = connection->Run(timeout, transferred, [&](auto done) {
+                    connection->WithStream([&](auto &stream) {
+                        boost::asio::async_read(stream, buffer, boost::asio::transfer_exactly(head.ContentLength - buffer.size()), done);
+                    });
+                });
+
+                if(error)
+                    throw boost::system::system_error(error);
+            }
+        } else {
+            error = connection->Run(timeout, transferred, [&](auto done) {
+                connection->WithStream([&](auto &stream) {
+                    boost::asio::async_read(stream, buffer, boost::asio::transfer_all(), done);
+                });
+            });
+
+            if(error != boost::asio::error::eof && error != boost::asio::ssl::error::stream_truncated)
+                throw boost::system::system_error(error);
+        }
+
+        std::string body = TakeBuffer(buffer, buffer.size());
+
+        if(head.KeepAlive)
+            Release(url, std::move(connection));
+
+        return body;
+    }
+}
+
+std::unique_ptr<SimpleTgPooledHttpClient::Connection> SimpleTgPooledHttpClient::Acquire(const TgBot::Url& url, std::chrono::seconds timeout, bool& reused) const {
+    const Endpoint endpoint = ParseEndpoint(url);
+    const std::string key = PoolKey(url);
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+
+        for (auto it = m_Idle.rbegin(); it != m_Idle.rend(); ++it) {
+            if(it->first != key)
+                continue;
+
+            std::unique_ptr<Connection> connection = std::move(it->second);
+            m_Idle.erase(std::next(it).base());
+            reused = true;
+            return connection;
+        }
+    }
+
+    reused = false;
+
+    auto connection = std::make_unique<Connection>(m_SslContext, endpoint.Tls);
+    boost::asio::ip::tcp::resolver resolver(connection->Context);
+    boost::asio::ip::tcp::resolver::results_type endpoints;
+
+    std::size_t transferred = 0;
+
+    // Timer closes the socket, cancelling the resolver is what stops a hanging lookup
+    boost::system::error_code error = connection->Run(timeout, transferred, [&](auto done) {
+        connection->Timer.async_wait([&resolver](boost::system::error_code error) {
+            if(!error)
+                resolver.cancel();
+        });
+        resolver.async_resolve(endpoint.Host, endpoint.Port, [&endpoints, done](boost::system::error_code error, boost::asio::ip::tcp::resolver::results_type results) {
+            endpoints = std::move(results);
+            done(error, 0);
+        });
+    });
+
+    if (!error) {
+        error = connection->Run(timeout, transferred, [&](auto done) {
+            boost::asio::async_connect(connection->Stream.lowest_layer(), endpoints, [done](boost::system::error_code error, const boost::asio::ip::tcp::endpoint &) {
+                done(error, 0);
+            });
+        });
+    }
+
+    if(!error)
+        connection->Stream.lowest_layer().set_option(boost::asio::ip::tcp::no_delay(true));
+
+    if (!error && endpoint.Tls) {
+        SSL_set_tlsext_host_name(connection->Stream.native_handle(), endpoint.Host.c_str());
+        connection->Stream.set_verify_callback(boost::asio::ssl::host_name_verification(endpoint.Host));
+
+        error = connection->Run(timeout, transferred, [&](auto done) {
+            connection->Stream.async_handshake(boost::asio::ssl::stream_base::client, [done](boost::system::error_code error) {
+                done(error, 0);
+            });
+        });
+    }
+
+    if(error)
+        throw boost::system::system_error(error);
+
+    return connection;
+}
+
+void SimpleTgPooledHttpClient::Release(const TgBot::Url& url, std::unique_ptr<Connection> connection) const {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    if(m_Idle.size() >= m_MaxIdle)
+        m_Idle.erase(m_Idle.begin());
+
+    m_Idle.emplace_back(PoolKey(url), std::move(connection));
+}
+
+struct SimpleTgBotHost::Connection {
+    SimpleTgPooledHttpClient::Stream Stream;
+    boost::asio::streambuf Buffer;
+    boost::asio::steady_timer Timer;
+    bool Reused = false;
+
+    Connection(boost::asio::io_context &context, boost::asio::ssl::context &ssl_context):
+        Stream(context, ssl_context),
+        Timer(context)
+    {}
+};
+
+struct SimpleTgBotHost::HostedBot {
+    SimpleTgBot &Bot;
+    std::string Path;
+    std::int32_t Limit;
+    std::int32_t Timeout;
+    std::string AllowedUpdates;
+    std::int32_t LastUpdateId = 0;
+    bool CatchingUp = false;
+    // Batch of a catch-up or reordered by admission, its offset is committed once it is drained
+    bool CommitPerBatch = false;
+    // Admitted updates of the last batch waiting for a worker, next poll is issued once it is empty
+    std::deque<TgBot::Update::Ptr> Queue;
+    boost::asio::steady_timer RetryTimer;
+    TgBot::TgTypeParser Parser;
+
+    HostedBot(SimpleTgBot &bot, boost::asio::io_context &context):
+        Bot(bot),
+        RetryTimer(context)
+    {}
+};
+
+SimpleTgBotHost::SimpleTgBotHost(std::size_t workers, std::size_t max_idle_connections, std::string api_host):
+    m_SslContext(boost::asio::ssl::context::tls_client),
+    m_Workers(workers),
+    m_Work(boost::asio::make_work_guard(m_Context)),
+    m_ApiHost(std::move(api_host)),
+    m_MaxIdleConnections(max_idle_connections),
+    m_HttpClient(max_idle_connections)
+{
+    ConfigureSslContext(m_SslContext);
+}
+
+SimpleTgBotHost::~SimpleTgBotHost() {
+    Stop();
+    m_Workers.join();
+}
+
+const TgBot::HttpClient& SimpleTgBotHost::GetHttpClient()const {
+    return m_HttpClient;
+}
+
+void SimpleTgBotHost::Add(SimpleTgBot& bot, std::int32_t limit, std::int32_t timeout, std::vector<std::string>&& allowed_updates) {
+    // Polls go to the host's server, everything else to the bot's, they must agree
+    if(bot.GetApiUrl() != "https://" + m_ApiHost)
+        bot.Log("Bot api url % differs from host api server %, updates and requests go to different servers", bot.GetApiUrl(), m_ApiHost);
+
+    auto hosted = std::make_shared<HostedBot>(bot, m_Context);
+    hosted->Path = Format("/bot%/getUpdates", bot.getToken());
+    hosted->Limit = limit;
+    hosted->Timeout = timeout;
+
+    if (auto checkpoint = bot.GetCheckpoint()) {
+        if (auto offset = checkpoint->Offset()) {
+            hosted->LastUpdateId = *offset;
+            hosted->CatchingUp = bot.IsCatchUpEnabled();
+        }
+    }
+
+    if (allowed_updates.size()) {
+        std::string json = "[";
+        for (const auto &update : allowed_updates)
+            json += Format("%\"%\"", json.size() > 1 ? "," : "", update);
+        json += "]";
+
+        hosted->AllowedUpdates = UrlEncode(json);
+    }
+
+    boost::asio::post(m_Context, [this, hosted]() {
+        m_Bots.push_back(hosted);
+        Poll(hosted);
+    });
+}
+
+void SimpleTgBotHost::Run() {
+    m_Context.run();
+}
+
+void SimpleTgBotHost::Stop() {
+    m_Work.reset();
+    m_Context.stop();
+}
+
+void SimpleTgBotHost::Poll(std::shared_ptr<HostedBot> bot) {
+    std::string body = Format("offset=%&limit=%&timeout=%", bot->LastUpdateId, bot->CatchingUp ? SimpleTgBot::MaxUpdatesLimit : bot->Limit, bot->Timeout);
+    if(bot->AllowedUpdates.size())
+        body += "&allowed_updates=" + bot->AllowedUpdates;
+
+    auto request = std::make_shared<std::string>(Format(
+        "POST % HTTP/1.1\r\nHost: %\r\nConnection: keep-alive\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: %\r\n\r\n",
+        bot->Path, m_ApiHost, body.size()
+    ));
+    *request += body;
+
+    Connect([this, bot, request](std::shared_ptr<Connection> connection, boost::system::error_code error) {
+        if(error)
+            return OnPollError(bot, error.message());
+
+        connection->Timer.expires_after(std::chrono::seconds(bot->Timeout + 10));
+        connection->Timer.async_wait([connection](boost::system::error_code error) {
+            if(error)
+                return;
+            boost::system::error_code ignored;
+            connection->Stream.lowest_layer().close(ignored);
+        });
+
+        auto fail = [this, bot, connection](boost::system::error_code error) {
+            connection->Timer.cancel();
+
+            if(connection->Reused)
+                return Poll(bot);
+
+            OnPollError(bot, error.message());
+        };
+
+        boost::asio::async_write(connection->Stream, boost::asio::buffer(*request), [this, bot, request, connection, fail](boost::system::error_code error, std::size_t) {
+            if(error)
+                return fail(error);
+
+            boost::asio::async_read_until(connection->Stream, connection->Buffer, "\r\n\r\n", [this, bot, connection, fail](boost::system::error_code error, std::size_t head_size) {
+                if(error)
+                    return fail(error);
+
+                ResponseHead head = ParseResponseHead(TakeBuffer(connection->Buffer, head_size));
+
+                if (head.Malformed) {
+                    connection->Timer.cancel();
+                    return OnPollError(bot, "Malformed response head");
+                }
+
+                if (head.Chunked || head.ContentLength == std::string::npos) {
+                    connection->Timer.cancel();
+                    return OnPollError(bot, "Response without content length is not supported");
+                }
+
+                std::size_t remaining = head.ContentLength > connection->Buffer.size() ? head.ContentLength - connection->Buffer.size() : 0;
+
+                boost::asio::async_read(connection->Stream, connection->Buffer, boost::asio::transfer_exactly(remaining), [this, bot, connection, head, fail](boost::system::error_code error, std::size_t) {
+                    if(error)
+                        return fail(error);
+
+                    connection->Timer.cancel();
+
+                    std::string body = TakeBuffer(connection->Buffer, connection->Buffer.size());
+
+                    if(head.KeepAlive)
+                        Release(connection);
+
+                    OnPollResponse(bot, body);
+                });
+            });
+        });
+    });
+}
+
+void SimpleTgBotHost::OnPollResponse(std::shared_ptr<HostedBot> bot, const std::string& body) {
+    std::vector<TgBot::Update::Ptr> updates;
+
+    try {
+        std::istringstream stream(body);
+        boost::property_tree::ptree tree;
+        boost::property_tree::read_json(stream, tree);
+
+        if(!tree.get<bool>("ok", false))
+            return OnPollError(bot, tree.get<std::string>("description", "Unknown error"));
+
+        updates = bot->Parser.parseJsonAndGetArray<TgBot::Update>(&TgBot::TgTypeParser::parseJsonAndGetUpdate, tree.get_child("result"));
+    } catch (const std::exception& e) {
+        return OnPollError(bot, e.what());
+    }
+
+    if(auto metrics = bot->Bot.GetMetrics())
+        metrics->RecordUpdateBatch(updates.size());
+
+    bot->CommitPerBatch = bot->CatchingUp || bot->Bot.GetAdmission();
+
+    if(bot->CatchingUp && updates.size() < static_cast<std::size_t>(SimpleTgBot::MaxUpdatesLimit))
+        bot->CatchingUp = false;
+
+    if (!updates.size()) {
+        if(auto checkpoint = bot->Bot.GetCheckpoint())
+            checkpoint->Flush();
+
+        return Poll(bot);
+    }
+
+    for (auto &update : updates) {
+        if(update->updateId >= bot->LastUpdateId)
+            bot->LastUpdateId = update->updateId + 1;
+    }
+
+    if (auto admission = bot->Bot.GetAdmission()) {
+        admission->Admit(updates);
+
+        if(auto report = admission->TakeReport())
+            bot->Bot.Log("%", *report);
+    }
+
+    for (auto &update : updates)
+        bot->Queue.push_back(std::move(update));
+
+    // Next poll is issued once the batch is handled, this keeps updates of a bot in order
+    boost::asio::post(m_Workers, [this, bot]() {
+        Drain(bot);
+    });
+}
+
+void SimpleTgBotHost::OnPollError(std::shared_ptr<HostedBot> bot, const std::string& reason) {
+    bot->Bot.Log("Hosted long poll failed: %", reason);
+
+    bot->RetryTimer.expires_after(std::chrono::seconds(1));
+    bot->RetryTimer.async_wait([this, bot](boost::system::error_code error) {
+        if(!error)
+            Poll(bot);
+    });
+}
+
+void SimpleTgBotHost::Drain(std::shared_ptr<HostedBot> bot) {
+    for (std::size_t i = 0; i < UpdatesPerTurn && bot->Queue.size(); i++) {
+        TgBot::Update::Ptr update = std::move(bot->Queue.front());
+        bot->Queue.pop_front();
+
+        // Lag includes the time spent in the queue, that is where a busy host loses it
+        auto metrics = bot->Bot.GetMetrics();
+        std::uint32_t date = metrics ? SimpleTgBot::GetUpdateDate(update) : 0;
+        if (date)
+            metrics->RecordPollLag(std::chrono::system_clock::now() - std::chrono::system_clock::from_time_t(date));
+
+        try {
+            auto tracer = bot->Bot.GetTracer();
+            SimpleTgTracer::Span span(tracer, "dispatch", "poll", tracer ? SimpleTgBot::GetUpdateChatId(update) : 0);
+            bot->Bot.getEventHandler().handleUpdate(update);
+        } catch (const std::exception& e) {
+            bot->Bot.Log("Hosted update handling failed: %", e.what());
+        }
+
+        auto checkpoint = bot->Bot.GetCheckpoint();
+        if(checkpoint && !bot->CommitPerBatch)
+            checkpoint->Commit(update->updateId + 1);
+    }
+
+    // Go to the back of the worker queue, so other bots get their turn
+    if (bot->Queue.size()) {
+        boost::asio::post(m_Workers, [this, bot]() {
+            Drain(bot);
+        });
+        return;
+    }
+
+    auto checkpoint = bot->Bot.GetCheckpoint();
+    if(checkpoint && bot->CommitPerBatch)
+        checkpoint->Commit(bot->LastUpdateId);
+
+    try {
+        bot->Bot.OnLongPollIteration();
+    } catch (const std::exception& e) {
+        bot->Bot.Log("LongPoolException: %", e.what());
+    }
+
+    boost::asio::post(m_Context, [this, bot]() {
+        Poll(bot);
+    });
+}
+
+void SimpleTgBotHost::Connect(std::function<void(std::shared_ptr<Connection>, boost::system::error_code)> callback) {
+    if (m_IdleConnections.size()) {
+        auto connection = std::move(m_IdleConnections.back());
+        m_IdleConnections.pop_back();
+        connection->Reused = true;
+        return callback(connection, {});
+    }
+
+    auto connection = std::make_shared<Connection>(m_Context, m_SslContext);
+    auto resolver = std::make_shared<boost::asio::ip::tcp::resolver>(m_Context);
+
+    // Armed before the lookup, a stalled resolve, connect or handshake must not stop polling of the bot for good
+    connection->Timer.expires_after(ConnectTimeout);
+    connection->Timer.async_wait([connection, resolver](boost::system::error_code error) {
+        if(error)
+            return;
+        resolver->cancel();
+        boost::system::error_code ignored;
+        connection->Stream.lowest_layer().close(ignored);
+    });
+
+    auto done = [connection, callback](boost::system::error_code error) {
+        const bool expired = connection->Timer.expiry() <= std::chrono::steady_clock::now();
+        connection->Timer.cancel();
+
+        callback(connection, error && expired ? boost::asio::error::timed_out : error);
+    };
+
+    resolver->async_resolve(m_ApiHost, "443", [this, connection, resolver, done](boost::system::error_code error, boost::asio::ip::tcp::resolver::results_type endpoints) {
+        if(error)
+            return done(error);
+
+        boost::asio::async_connect(connection->Stream.lowest_layer(), endpoints, [this, connection, done](boost::system::error_code error, const boost::asio::ip::tcp::endpoint &) {
+            if(error)
+                return done(error);
+
+            SSL_set_tlsext_host_name(connection->Stream.native_handle(), m_ApiHost.c_str());
+            connection->Stream.set_verify_callback(boost::asio::ssl::host_name_verification(m_ApiHost));
+
+            connection->Stream.async_handshake(boost::asio::ssl::stream_base::client, [done](boost::system::error_code error) {
+                done(error);
+            });
+        });
+    });
+}
+
+void SimpleTgBotHost::Release(std::shared_ptr<Connection> connection) {
+    if(m_IdleConnections.size() >= m_MaxIdleConnections)
+        return;
+
+    connection->Reused = false;
+    m_IdleConnections.push_back(std::move(connection));
+}
@@ -0,0 +1,330 @@
+#include "simple/tg_html.hpp"
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMPLE_TG_HTML_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static std::size_t CountTrailingZeros(std::uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static bool IsSpecial(char ch) {
+    return ch == '<' || ch == '>' || ch == '&' || ch == '"';
+}
+
+// Index of the first of <>&" or size, 16 bytes per step where SSE2 is there
+static std::size_t FindSpecial(const char *data, std::size_t size) {
+    std::size_t i = 0;
+
+#ifdef SIMPLE_TG_HTML_SSE2
+    const __m128i less = _mm_set1_epi8('<');
+    const __m128i greater = _mm_set1_epi8('>');
+    const __m128i ampersand = _mm_set1_epi8('&');
+    const __m128i quote = _mm_set1_epi8('"');
+
+    for (; i + 16 <= size; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+
+        const __m128i matches = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, less), _mm_cmpeq_epi8(chunk, greater)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, ampersand), _mm_cmpeq_epi8(chunk, quote))
+        );
+
+        const std::uint32_t mask = static_cast<std::uint32_t>(_mm_movemask_epi8(matches));
+
+        if(mask)
+            return i + CountTrailingZeros(mask);
+    }
+#endif
+
+    for (; i < size; i++) {
+        if(IsSpecial(data[i]))
+            return i;
+    }
+
+    return size;
+}
+
+SimpleTgHtmlBuilder::SimpleTgHtmlBuilder(std::size_t reserve) {
+    m_Buffer.reserve(reserve);
+}
+
+SimpleTgHtmlBuilder& SimpleTgHtmlBuilder::Text(std::string_view text) {
+    AppendEscaped(m_Buffer, text);
+    return *this;
+}
+
+SimpleTgHtmlBuilder& SimpleTgHtmlBuilder::Line(std::string_view text) {
+    AppendEscaped(m_Buffer, text);
+    m_Buffer.push_back('\n');
+    return *this;
+}
+
+SimpleTgHtmlBuilder& SimpleTgHtmlBuilder::Raw(std::string_view html) {
+    m_Buffer.append(html);
+    return *this;
+}
+
+SimpleTgHtmlBuilder& SimpleTgHtmlBuilder::Open(std::string_view tag) {
+    m_Buffer.push_back('<');
+    m_Buffer.append(tag);
+    m_Buffer.push_back('>');
+    // Attributes stay in the opening tag only, "span class=..." closes as "</span>"
+    m_OpenTags.emplace_back(tag.substr(0, tag.find_first_of(" \t\n")));
+    return *this;
+}
+
+SimpleTgHtmlBuilder& SimpleTgHtmlBuilder::Close() {
+    if(!m_OpenTags.size())
+        return *this;
+
+    m_Buffer.append("</");
+    m_Buffer.append(m_OpenTags.back());
+    m_Buffer.push_back('>');
+    m_OpenTags.pop_back();
+    return *this;
+}
+
+SimpleTgHtmlBuilder& SimpleTgHtmlBuilder::Tagged(std::string_view tag, std::string_view text) {
+    return Open(tag).Text(text).Close();
+}
+
+SimpleTgHtmlBuilder& SimpleTgHtmlBuilder::Link(std::string_view url, std::string_view text) {
+    m_Buffer.append("<a href=\"");
+    AppendEscaped(m_Buffer, url);
+    m_Buffer.append("\">");
+    AppendEscaped(m_Buffer, text);
+    m_Buffer.append("</a>");
+    return *this;
+}
+
+const std::string& SimpleTgHtmlBuilder::Str() {
+    while(m_OpenTags.size())
+        Close();
+
+    return m_Buffer;
+}
+
+std::string SimpleTgHtmlBuilder::Take() {
+    Str();
+
+    std::string result = std::move(m_Buffer);
+    Clear();
+    return result;
+}
+
+std::vector<std::string> SimpleTgHtmlBuilder::Split(std::size_t limit) {
+    return SplitMessage(Str(), limit);
+}
+
+void SimpleTgHtmlBuilder::Clear() {
+    m_Buffer.clear();
+    m_OpenTags.clear();
+}
+
+void SimpleTgHtmlBuilder::AppendEscaped(std::string& out, std::string_view text) {
+    // Common case of nothing to escape is a single scan and copy
+    out.reserve(out.size() + text.size());
+
+    while (text.size()) {
+        const std::size_t special = FindSpecial(text.data(), text.size());
+
+        out.append(text.data(), special);
+
+        if(special == text.size())
+            break;
+
+        switch (text[special]) {
+        case '<': out.append("&lt;"); break;
+        case '>': out.append("&gt;"); break;
+        case '&': out.append("&amp;"); break;
+        case '"': out.append("&quot;"); break;
+        }
+
+        text.remove_prefix(special + 1);
+    }
+}
+
+std::string SimpleTgHtmlBuilder::Escape(std::string_view text) {
+    std::string escaped;
+    AppendEscaped(escaped, text);
+    return escaped;
+}
+
+namespace {
+
+struct OpenTag {
+    std::string_view Markup;
+    std::string_view Name;
+};
+
+struct Break {
+    std::size_t Input = 0;
+    std::size_t Length = 0;
+    std::vector<OpenTag> Tags;
+};
+
+}
+
+static std::size_t ClosingSize(const std::vector<OpenTag>& tags) {
+    std::size_t size = 0;
+    for (const auto &tag : tags)
+        size += tag.Name.size() + 3;
+    return size;
+}
+
+static void AppendClosing(std::string& out, const std::vector<OpenTag>& tags) {
+    for (auto it = tags.rbegin(); it != tags.rend(); ++it) {
+        out.append("</");
+        out.append(it->Name);
+        out.push_back('>');
+    }
+}
+
+static void AppendOpening(std::string& out, const std::vector<OpenTag>& tags) {
+    for (const auto &tag : tags)
+        out.append(tag.Markup);
+}
+
+// Longest entity Telegram knows is &quot; or a numeric one like &#x1F600;
+static constexpr std::size_t MaxEntitySize = 10;
+
+// Tags, entities and utf-8 sequences are never cut
+static std::size_t TokenSize(std::string_view html, std::size_t i) {
+    const char ch = html[i];
+
+    if (ch == '<') {
+        const std::size_t end = html.find('>', i);
+        return end == std::string_view::npos ? html.size() - i : end - i + 1;
+    }
+
+    // Bare ampersand is a token of its own, so one can't swallow the text up to some far semicolon
+    if (ch == '&') {
+        const std::size_t end = html.substr(i, MaxEntitySize).find(';');
+        return end == std::string_view::npos ? 1 : end + 1;
+    }
+
+    const auto byte = static_cast<unsigned char>(ch);
+    const std::size_t length = byte < 0x80 ? 1 : byte >= 0xf0 ? 4 : byte >= 0xe0 ? 3 : byte >= 0xc0 ? 2 : 1;
+
+    return std::min(length, html.size() - i);
+}
+
+std::vector<std::string> SimpleTgHtmlBuilder::SplitMessage(std::string_view html, std::size_t limit) {
+    std::vector<std::string> parts;
+
+    if (html.size() <= limit) {
+        if(html.size())
+            parts.emplace_back(html);
+        return parts;
+    }
+
+    std::string current;
+    current.reserve(limit);
+
+    std::vector<OpenTag> tags;
+    std::size_t closing = 0;
+    // Part with reopened tags and whitespace only is empty for Telegram
+    bool has_text = false;
+    bool continued = false;
+    Break line;
+    Break word;
+
+    auto flush = [&]() {
+        AppendClosing(current, tags);
+        parts.push_back(std::move(current));
+
+        current.clear();
+        current.reserve(limit);
+        AppendOpening(current, tags);
+
+        has_text = false;
+        continued = true;
+        line.Length = 0;
+        word.Length = 0;
+    };
+
+    auto remember = [&](Break &at, std::size_t input) {
+        at.Input = input;
+        at.Length = current.size();
+        at.Tags = tags;
+    };
+
+    for (std::size_t i = 0; i < html.size();) {
+        const std::size_t size = TokenSize(html, i);
+        const std::string_view token = html.substr(i, size);
+        const bool is_space = token == " " || token == "\n" || token == "\t" || token == "\r";
+
+        // Whitespace the previous part was cut at would only indent the next one
+        if (continued && !has_text && is_space) {
+            i += size;
+            continue;
+        }
+
+        const bool is_tag = token.size() > 1 && token[0] == '<';
+        const bool is_closing = is_tag && token[1] == '/';
+
+        OpenTag opened;
+        std::size_t next_closing = closing;
+
+        if (is_closing && tags.size()) {
+            next_closing -= tags.back().Name.size() + 3;
+        } else if (is_tag && !is_closing) {
+            const std::size_t name_end = token.find_first_of(" >", 1);
+            opened = {token, token.substr(1, name_end - 1)};
+            next_closing += opened.Name.size() + 3;
+        }
+
+        if (current.size() + token.size() + next_closing > limit && has_text) {
+            Break *at = line.Length ? &line : word.Length ? &word : nullptr;
+
+            // Rewind to the boundary, text after it goes to the next part
+            if (at) {
+                current.resize(at->Length);
+                tags = at->Tags;
+                closing = ClosingSize(tags);
+                i = at->Input;
+            }
+
+            flush();
+            continue;
+        }
+
+        current.append(token);
+        closing = next_closing;
+        i += size;
+
+        if (is_closing) {
+            if(tags.size())
+                tags.pop_back();
+        } else if (is_tag) {
+            tags.push_back(opened);
+        } else if (!is_space) {
+            has_text = true;
+        }
+
+        // Cutting before any text would leave a part that is empty for Telegram
+        if(has_text && token == "\n")
+            remember(line, i);
+        else if(has_text && token == " ")
+            remember(word, i);
+    }
+
+    if(has_text)
+        parts.push_back(std::move(current));
+
+    return parts;
+}
@@ -0,0 +1,114 @@
+#include "simple/tg_inline.hpp"
+
+SimpleTgInlineResultCache::SimpleTgInlineResultCache(std::size_t capacity):
+    m_Capacity(capacity)
+{}
+
+void SimpleTgInlineResultCache::SetCapacity(std::size_t capacity) {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    m_Capacity = capacity;
+
+    while (m_Entries.size() > m_Capacity) {
+        m_Index.erase(m_Entries.back().Key);
+        m_Entries.pop_back();
+    }
+}
+
+SimpleTgInlineResultCache::AnswerPtr SimpleTgInlineResultCache::Find(const TgBot::InlineQuery& query) {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    if(auto answer = FindLocked(Key(query, false)))
+        return answer;
+
+    return query.from ? FindLocked(Key(query, true)) : nullptr;
+}
+
+SimpleTgInlineResultCache::AnswerPtr SimpleTgInlineResultCache::FindLocked(const std::string& key) {
+    auto it = m_Index.find(key);
+
+    if(it == m_Index.end())
+        return nullptr;
+
+    if (it->second->Expires <= std::chrono::steady_clock::now()) {
+        m_Entries.erase(it->second);
+        m_Index.erase(it);
+        return nullptr;
+    }
+
+    m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+
+    return it->second->Answer;
+}
+
+void SimpleTgInlineResultCache::Insert(const TgBot::InlineQuery& query, AnswerPtr answer) {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    if(!m_Capacity || !answer || answer->CacheTime <= 0 || (answer->Personal && !query.from))
+        return;
+
+    std::string key = Key(query, answer->Personal);
+    const auto expires = std::chrono::steady_clock::now() + std::chrono::seconds(answer->CacheTime);
+
+    auto it = m_Index.find(key);
+
+    if (it != m_Index.end()) {
+        it->second->Answer = std::move(answer);
+        it->second->Expires = expires;
+        m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+        return;
+    }
+
+    m_Entries.push_front({std::move(key), std::move(answer), expires});
+    m_Index.emplace(m_Entries.front().Key, m_Entries.begin());
+
+    if (m_Entries.size() > m_Capacity) {
+        m_Index.erase(m_Entries.back().Key);
+        m_Entries.pop_back();
+    }
+}
+
+void SimpleTgInlineResultCache::Clear() {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    m_Index.clear();
+    m_Entries.clear();
+}
+
+std::size_t SimpleTgInlineResultCache::Size()const {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    return m_Entries.size();
+}
+
+std::string SimpleTgInlineResultCache::Normalize(const std::string& query) {
+    std::string normalized;
+    normalized.reserve(query.size());
+
+    bool space = false;
+
+    for (char ch : query) {
+        if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r') {
+            space = normalized.size() > 0;
+            continue;
+        }
+
+        if(space)
+            normalized.push_back(' ');
+        space = false;
+
+        normalized.push_back(ch >= 'A' && ch <= 'Z' ? char(ch - 'A' + 'a') : ch);
+    }
+
+    return normalized;
+}
+
+std::string SimpleTgInlineResultCache::Key(const TgBot::InlineQuery& query, bool personal) {
+    // Newline can't survive normalization, so parts never run into each other
+    std::string key = Normalize(query.query) + '\n' + query.offset;
+
+    if(personal)
+        key += '\n' + std::to_string(query.from->id);
+
+    return key;
+}
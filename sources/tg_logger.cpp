@@ -8,19 +8,73 @@ SimpleTgLogger::SimpleTgLogger(const std::string &token, std::int64_t log_chat,
 	m_BotName(bot_name),
 	m_IsEnabled(true)
 {
-	try {
-		m_LogChat = m_Bot.getApi().getChat(m_LogChatId);
-	} catch (const std::exception &exception) {
-		Println("Can't get chat for chat_id % with token %, reason: %", m_LogChatId, m_Bot.getToken(), exception.what());
+	m_Sender = std::thread(&SimpleTgLogger::RunSender, this);
+}
+
+SimpleTgLogger::~SimpleTgLogger() {
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_IsStopping = true;
 	}
+	m_Changed.notify_all();
+	m_Sender.join();
 }
 
 bool SimpleTgLogger::IsValid() const {
+	std::unique_lock<std::mutex> lock(m_Lock);
+	m_Changed.wait(lock, [this] { return m_IsResolved; });
+
 	return (bool)m_LogChat;
 }
 
 void SimpleTgLogger::Log(const std::string& message) {
-	if (!m_IsEnabled || !m_LogChat || !message.size()) {
+	if (!m_IsEnabled || !message.size()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_PendingMessages.push_back(message);
+	}
+	m_Changed.notify_all();
+}
+
+void SimpleTgLogger::RunSender() {
+	TgBot::Chat::Ptr chat;
+
+	try {
+		chat = m_Bot.getApi().getChat(m_LogChatId);
+	} catch (const std::exception &exception) {
+		Println("Can't get chat for chat_id % with token %, reason: %", m_LogChatId, m_Bot.getToken(), exception.what());
+	}
+
+	std::unique_lock<std::mutex> lock(m_Lock);
+
+	m_LogChat = chat;
+	m_IsResolved = true;
+	m_Changed.notify_all();
+
+	for (;;) {
+		m_Changed.wait(lock, [this] { return m_IsStopping || m_PendingMessages.size(); });
+
+		if (!m_PendingMessages.size())
+			return;
+
+		std::vector<std::string> messages;
+		messages.swap(m_PendingMessages);
+
+		// Senders only ever wait for the swap, not for Telegram
+		lock.unlock();
+
+		for (const auto &message : messages)
+			Send(message);
+
+		lock.lock();
+	}
+}
+
+void SimpleTgLogger::Send(const std::string& message) {
+	if (!m_LogChat) {
 		return;
 	}
 
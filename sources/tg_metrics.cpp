@@ -0,0 +1,375 @@
+#include "simple/tg_metrics.hpp"
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <boost/asio.hpp>
+#include <bsl/format.hpp>
+
+// Scrape requests are a few hundred bytes, anything bigger is not prometheus
+static constexpr std::size_t MaxRequestSize = 8192;
+
+static std::atomic<std::uint64_t> s_NextMetricsId{1};
+
+SimpleTgMetrics::SimpleTgMetrics():
+    m_Id(s_NextMetricsId++)
+{
+    m_SeriesNames.reserve(MaxSeries);
+    m_SeriesNames.push_back({SeriesKind::UpdateBatch, "getUpdates"});
+    m_SeriesNames.push_back({SeriesKind::PollLag, "getUpdates"});
+    m_SeriesNames.push_back({SeriesKind::ApiCall, "other"});
+    m_SeriesNames.push_back({SeriesKind::Handler, "other"});
+}
+
+void SimpleTgMetrics::RecordApiCall(const std::string& method, std::chrono::steady_clock::duration latency, bool failed) {
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+
+    Record(FindSeries(SeriesKind::ApiCall, method), micros > 0 ? micros : 0, failed);
+}
+
+void SimpleTgMetrics::RecordHandler(const std::string& name, std::chrono::steady_clock::duration duration, bool failed) {
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+
+    Record(FindSeries(SeriesKind::Handler, name), micros > 0 ? micros : 0, failed);
+}
+
+void SimpleTgMetrics::RecordUpdateBatch(std::size_t size) {
+    Record(UpdateBatchSeries, size, false);
+}
+
+void SimpleTgMetrics::RecordPollLag(std::chrono::system_clock::duration lag) {
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(lag).count();
+
+    Record(PollLagSeries, micros > 0 ? micros : 0, false);
+}
+
+SimpleTgMetrics::Snapshot SimpleTgMetrics::Collect()const {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    std::vector<Histogram> totals(m_SeriesNames.size());
+
+    for (const auto &shard : m_Shards) {
+        for (std::size_t i = 0; i < totals.size(); i++) {
+            const Series &series = shard->Entries[i];
+            Histogram &total = totals[i];
+
+            total.Count += series.Count.load(std::memory_order_relaxed);
+            total.Errors += series.Errors.load(std::memory_order_relaxed);
+            total.Sum += series.Sum.load(std::memory_order_relaxed);
+
+            for (std::size_t bucket = 0; bucket < BucketsCount; bucket++)
+                total.Buckets[bucket] += series.Buckets[bucket].load(std::memory_order_relaxed);
+        }
+    }
+
+    Snapshot snapshot;
+    snapshot.UpdateBatches = totals[UpdateBatchSeries];
+    snapshot.PollLag = totals[PollLagSeries];
+
+    for (std::size_t i = ApiCallOverflowSeries; i < totals.size(); i++) {
+        const SeriesName &name = m_SeriesNames[i];
+
+        if(name.Kind == SeriesKind::ApiCall)
+            snapshot.ApiCalls[name.Name] = totals[i];
+        if(name.Kind == SeriesKind::Handler)
+            snapshot.Handlers[name.Name] = totals[i];
+    }
+
+    return snapshot;
+}
+
+// Label values are user supplied handler names, quote, backslash and newline must be escaped
+static std::string EscapeLabel(const std::string &value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+
+    for (char ch : value) {
+        switch (ch) {
+        case '\\': escaped += "\\\\"; break;
+        case '"': escaped += "\\\""; break;
+        case '\n': escaped += "\\n"; break;
+        default: escaped += ch;
+        }
+    }
+
+    return escaped;
+}
+
+static void WritePrometheusHistogram(std::ostream &stream, const char *name, const std::string &labels, const SimpleTgMetrics::Histogram &histogram, double scale) {
+    const std::string separator = labels.size() ? "," : "";
+
+    std::uint64_t cumulative = 0;
+    for (std::size_t i = 0; i + 1 < SimpleTgMetrics::BucketsCount; i++) {
+        cumulative += histogram.Buckets[i];
+        stream << name << "_bucket{" << labels << separator << "le=\"" << double(std::uint64_t(1) << i) * scale << "\"} " << cumulative << '\n';
+    }
+    stream << name << "_bucket{" << labels << separator << "le=\"+Inf\"} " << histogram.Count << '\n';
+    stream << name << "_sum{" << labels << "} " << double(histogram.Sum) * scale << '\n';
+    stream << name << "_count{" << labels << "} " << histogram.Count << '\n';
+}
+
+std::string SimpleTgMetrics::ToPrometheusText()const {
+    constexpr double Seconds = 1e-6;
+
+    Snapshot snapshot = Collect();
+
+    std::ostringstream stream;
+
+    stream << "# TYPE simple_tg_api_request_seconds histogram\n";
+    for (const auto &[method, histogram] : snapshot.ApiCalls)
+        WritePrometheusHistogram(stream, "simple_tg_api_request_seconds", Format("method=\"%\"", EscapeLabel(method)), histogram, Seconds);
+
+    stream << "# TYPE simple_tg_api_errors_total counter\n";
+    for (const auto &[method, histogram] : snapshot.ApiCalls)
+        stream << "simple_tg_api_errors_total{method=\"" << EscapeLabel(method) << "\"} " << histogram.Errors << '\n';
+
+    stream << "# TYPE simple_tg_handler_seconds histogram\n";
+    for (const auto &[handler, histogram] : snapshot.Handlers)
+        WritePrometheusHistogram(stream, "simple_tg_handler_seconds", Format("handler=\"%\"", EscapeLabel(handler)), histogram, Seconds);
+
+    stream << "# TYPE simple_tg_handler_errors_total counter\n";
+    for (const auto &[handler, histogram] : snapshot.Handlers)
+        stream << "simple_tg_handler_errors_total{handler=\"" << EscapeLabel(handler) << "\"} " << histogram.Errors << '\n';
+
+    stream << "# TYPE simple_tg_update_batch_size histogram\n";
+    WritePrometheusHistogram(stream, "simple_tg_update_batch_size", "", snapshot.UpdateBatches, 1.0);
+
+    stream << "# TYPE simple_tg_poll_lag_seconds histogram\n";
+    WritePrometheusHistogram(stream, "simple_tg_poll_lag_seconds", "", snapshot.PollLag, Seconds);
+
+    return stream.str();
+}
+
+std::size_t SimpleTgMetrics::BucketIndex(std::uint64_t value) {
+    std::size_t index = 0;
+    std::uint64_t bound = 1;
+
+    while (value > bound && index + 1 < BucketsCount) {
+        bound <<= 1;
+        index++;
+    }
+
+    return index;
+}
+
+void SimpleTgMetrics::Record(std::size_t index, std::uint64_t value, bool failed) {
+    Series &series = Local().Owner->Entries[index];
+
+    // Shard is written only by the owning thread, so plain load/store is enough
+    auto add = [](std::atomic<std::uint64_t> &counter, std::uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    };
+
+    add(series.Count, 1);
+    add(series.Sum, value);
+    add(series.Buckets[BucketIndex(value)], 1);
+
+    if(failed)
+        add(series.Errors, 1);
+}
+
+std::size_t SimpleTgMetrics::FindSeries(SeriesKind kind, const std::string& name) {
+    auto &local_indices = Local().SeriesIndices[kind == SeriesKind::ApiCall ? 0 : 1];
+
+    auto it = local_indices.find(name);
+
+    if(it != local_indices.end())
+        return it->second;
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    std::size_t index = kind == SeriesKind::ApiCall ? ApiCallOverflowSeries : HandlerOverflowSeries;
+
+    auto global = m_SeriesIndices.find({kind, name});
+
+    if (global != m_SeriesIndices.end()) {
+        index = global->second;
+    } else if (m_SeriesNames.size() < MaxSeries) {
+        index = m_SeriesNames.size();
+        m_SeriesNames.push_back({kind, name});
+        m_SeriesIndices[{kind, name}] = index;
+    }
+
+    local_indices[name] = index;
+
+    return index;
+}
+
+SimpleTgMetrics::LocalState &SimpleTgMetrics::Local() {
+    static thread_local std::vector<LocalState> s_LocalStates;
+
+    for (auto &state : s_LocalStates) {
+        if(state.MetricsId == m_Id)
+            return state;
+    }
+
+    // States of destroyed metrics are useless, drop them while here
+    s_LocalStates.erase(std::remove_if(s_LocalStates.begin(), s_LocalStates.end(), [](const LocalState &state) {
+        return state.Owner.get_deleter().Free.expired();
+    }), s_LocalStates.end());
+
+    Shard *shard = nullptr;
+    {
+        // Counters of a reused shard keep counting, totals are sums over all shards anyway
+        std::lock_guard<std::mutex> lock(m_FreeShards->Lock);
+
+        if (m_FreeShards->Shards.size()) {
+            shard = m_FreeShards->Shards.back();
+            m_FreeShards->Shards.pop_back();
+        }
+    }
+
+    if (!shard) {
+        std::lock_guard<std::mutex> lock(m_Lock);
+
+        m_Shards.push_back(std::make_unique<Shard>());
+        shard = m_Shards.back().get();
+    }
+
+    s_LocalStates.push_back({m_Id, std::unique_ptr<Shard, ShardReturn>(shard, ShardReturn{m_FreeShards}), {}});
+
+    return s_LocalStates.back();
+}
+
+void SimpleTgMetrics::ShardReturn::operator()(Shard *shard)const {
+    // Shard itself is owned by metrics, thread only gives up writing to it
+    if (auto free = Free.lock()) {
+        std::lock_guard<std::mutex> lock(free->Lock);
+        free->Shards.push_back(shard);
+    }
+}
+
+SimpleTgMetricsHttpClient::SimpleTgMetricsHttpClient(SimpleTgMetrics& metrics, const TgBot::HttpClient& client):
+    m_Client(client),
+    m_Metrics(metrics)
+{
+    _timeout = m_Client._timeout;
+}
+
+std::string SimpleTgMetricsHttpClient::makeRequest(const TgBot::Url& url, const std::vector<TgBot::HttpReqArg>& args) const {
+    // Long polls adjust timeout of the client they are given, pass it through
+    const_cast<TgBot::HttpClient&>(m_Client)._timeout = _timeout;
+
+    const std::string method = GetMethodName(url.path);
+    const auto start = std::chrono::steady_clock::now();
+
+    try {
+        std::string response = m_Client.makeRequest(url, args);
+
+        bool failed = response.compare(0, 11, "{\"ok\":false") == 0;
+        m_Metrics.RecordApiCall(method, std::chrono::steady_clock::now() - start, failed);
+
+        return response;
+    } catch (...) {
+        m_Metrics.RecordApiCall(method, std::chrono::steady_clock::now() - start, true);
+        throw;
+    }
+}
+
+std::string SimpleTgMetricsHttpClient::GetMethodName(const std::string& path) {
+    std::size_t slash = path.rfind('/');
+
+    if(slash == std::string::npos)
+        return path;
+
+    return path.substr(slash + 1);
+}
+
+struct SimpleTgMetricsExporter::Server {
+    const SimpleTgMetrics &Metrics;
+    boost::asio::io_context Context;
+    boost::asio::ip::tcp::acceptor Acceptor;
+    std::thread Thread;
+
+    Server(const SimpleTgMetrics &metrics):
+        Metrics(metrics),
+        Acceptor(Context)
+    {}
+
+    void Accept();
+};
+
+SimpleTgMetricsExporter::SimpleTgMetricsExporter(const SimpleTgMetrics& metrics):
+    m_Server(std::make_unique<Server>(metrics))
+{}
+
+SimpleTgMetricsExporter::~SimpleTgMetricsExporter() {
+    Stop();
+}
+
+bool SimpleTgMetricsExporter::Start(std::uint16_t port, const std::string& address) {
+    if(IsRunning())
+        return false;
+
+    boost::system::error_code error;
+    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address(address, error), port);
+
+    if(error)
+        return false;
+
+    auto &acceptor = m_Server->Acceptor;
+
+    acceptor.open(endpoint.protocol(), error);
+    if(!error)
+        acceptor.set_option(boost::asio::socket_base::reuse_address(true), error);
+    if(!error)
+        acceptor.bind(endpoint, error);
+    if(!error)
+        acceptor.listen(boost::asio::socket_base::max_listen_connections, error);
+
+    if (error) {
+        acceptor.close(error);
+        return false;
+    }
+
+    m_Server->Context.restart();
+    m_Server->Accept();
+
+    m_Server->Thread = std::thread([server = m_Server.get()]() {
+        server->Context.run();
+    });
+
+    return true;
+}
+
+void SimpleTgMetricsExporter::Stop() {
+    if(!IsRunning())
+        return;
+
+    m_Server->Context.stop();
+    m_Server->Thread.join();
+
+    boost::system::error_code error;
+    m_Server->Acceptor.close(error);
+}
+
+bool SimpleTgMetricsExporter::IsRunning()const {
+    return m_Server->Thread.joinable();
+}
+
+void SimpleTgMetricsExporter::Server::Accept() {
+    Acceptor.async_accept([this](boost::system::error_code error, boost::asio::ip::tcp::socket socket) {
+        if(error == boost::asio::error::operation_aborted)
+            return;
+
+        if (!error) {
+            auto connection = std::make_shared<boost::asio::ip::tcp::socket>(std::move(socket));
+            auto request = std::make_shared<boost::asio::streambuf>(MaxRequestSize);
+
+            boost::asio::async_read_until(*connection, *request, "\r\n\r\n", [this, connection, request](boost::system::error_code error, std::size_t) {
+                if(error)
+                    return;
+
+                std::string body = Metrics.ToPrometheusText();
+                auto response = std::make_shared<std::string>(Format("HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %\r\nConnection: close\r\n\r\n", body.size()));
+                *response += body;
+
+                boost::asio::async_write(*connection, boost::asio::buffer(*response), [connection, response](boost::system::error_code, std::size_t) {
+                    boost::system::error_code ignored;
+                    connection->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+                });
+            });
+        }
+
+        Accept();
+    });
+}
@@ -0,0 +1,350 @@
+#include "simple/tg_session.hpp"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr std::uint64_t SessionStoreMagic = 0x5347544e4f535353ull;
+static constexpr std::uint32_t SessionStoreVersion = 2;
+static constexpr std::size_t MaxShards = 64;
+// Slots per stored session, load factor stays at or below 1/2
+static constexpr std::size_t SlotsPerSession = 2;
+
+struct SimpleTgSessionStore::Header {
+    std::uint64_t Magic;
+    std::uint32_t Version;
+    std::uint32_t ValueSize;
+    std::uint64_t ShardSlots;
+    std::uint64_t ShardsCount;
+    std::uint64_t Sizes[MaxShards];
+};
+
+// Slot layout: used flag, chat id, user id, value padded to 8 bytes
+static constexpr std::size_t SlotHeaderSize = 3 * sizeof(std::uint64_t);
+
+static std::uint64_t &SlotUsed(std::uint8_t *slot) {
+    return *reinterpret_cast<std::uint64_t*>(slot);
+}
+
+static std::int64_t &SlotChat(std::uint8_t *slot) {
+    return *reinterpret_cast<std::int64_t*>(slot + sizeof(std::uint64_t));
+}
+
+static std::int64_t &SlotUser(std::uint8_t *slot) {
+    return *reinterpret_cast<std::int64_t*>(slot + 2 * sizeof(std::uint64_t));
+}
+
+static std::uint8_t *SlotValue(std::uint8_t *slot) {
+    return slot + SlotHeaderSize;
+}
+
+SimpleTgSessionStore::SimpleTgSessionStore(const std::string& path, std::size_t value_size, std::size_t capacity):
+    m_Path(path),
+    m_ValueSize(value_size),
+    m_SlotSize(SlotHeaderSize + (value_size + 7) / 8 * 8)
+{
+    if(!value_size || !capacity)
+        return;
+
+    Map(capacity);
+}
+
+SimpleTgSessionStore::~SimpleTgSessionStore() {
+    Flush();
+    Unmap();
+}
+
+bool SimpleTgSessionStore::IsValid()const {
+    return m_Header != nullptr;
+}
+
+bool SimpleTgSessionStore::Read(std::int64_t chat_id, std::int64_t user_id, void* value, std::size_t size) {
+    if(!IsValid())
+        return false;
+
+    const std::uint64_t hash = Hash(chat_id, user_id);
+    Shard &shard = ShardOf(hash);
+
+    std::lock_guard<std::mutex> lock(shard.Lock);
+
+    bool found = false;
+    std::uint8_t *slot = Find(shard, hash, chat_id, user_id, found);
+
+    if(!found)
+        return false;
+
+    std::memcpy(value, SlotValue(slot), std::min(size, m_ValueSize));
+    return true;
+}
+
+bool SimpleTgSessionStore::Write(std::int64_t chat_id, std::int64_t user_id, const void* value, std::size_t size) {
+    size = std::min(size, m_ValueSize);
+
+    return Modify(chat_id, user_id, [&](void *slot, bool) {
+        std::memcpy(slot, value, size);
+        std::memset(static_cast<std::uint8_t*>(slot) + size, 0, m_ValueSize - size);
+    });
+}
+
+bool SimpleTgSessionStore::Modify(std::int64_t chat_id, std::int64_t user_id, const Modifier& modifier) {
+    if(!IsValid())
+        return false;
+
+    const std::uint64_t hash = Hash(chat_id, user_id);
+    Shard &shard = ShardOf(hash);
+
+    std::lock_guard<std::mutex> lock(shard.Lock);
+
+    bool found = false;
+    std::uint8_t *slot = Find(shard, hash, chat_id, user_id, found);
+
+    if(!slot)
+        return false;
+
+    if (!found) {
+        if(ShardSize(shard) >= m_ShardLimit)
+            return false;
+
+        std::memset(SlotValue(slot), 0, m_SlotSize - SlotHeaderSize);
+        SlotChat(slot) = chat_id;
+        SlotUser(slot) = user_id;
+        SlotUsed(slot) = 1;
+        ShardSize(shard)++;
+    }
+
+    modifier(SlotValue(slot), !found);
+    return true;
+}
+
+bool SimpleTgSessionStore::Erase(std::int64_t chat_id, std::int64_t user_id) {
+    if(!IsValid())
+        return false;
+
+    const std::uint64_t hash = Hash(chat_id, user_id);
+    Shard &shard = ShardOf(hash);
+
+    std::lock_guard<std::mutex> lock(shard.Lock);
+
+    bool found = false;
+    std::uint8_t *slot = Find(shard, hash, chat_id, user_id, found);
+
+    if(!found)
+        return false;
+
+    // Backward shift deletion, keeps probe chains intact without tombstones
+    std::size_t hole = (slot - shard.Slots) / m_SlotSize;
+    std::size_t index = hole;
+
+    for (;;) {
+        index = (index + 1) % m_ShardSlots;
+
+        std::uint8_t *next = Slot(shard, index);
+
+        if(!SlotUsed(next))
+            break;
+
+        std::size_t home = HomeIndex(Hash(SlotChat(next), SlotUser(next)));
+
+        bool stays = hole <= index ? (hole < home && home <= index) : (hole < home || home <= index);
+
+        if(stays)
+            continue;
+
+        std::memcpy(Slot(shard, hole), next, m_SlotSize);
+        hole = index;
+    }
+
+    SlotUsed(Slot(shard, hole)) = 0;
+    ShardSize(shard)--;
+
+    return true;
+}
+
+std::size_t SimpleTgSessionStore::Size()const {
+    if(!IsValid())
+        return 0;
+
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < m_ShardsCount; i++) {
+        std::lock_guard<std::mutex> lock(m_Shards[i].Lock);
+        size += m_Header->Sizes[i];
+    }
+
+    return size;
+}
+
+std::size_t SimpleTgSessionStore::Capacity()const {
+    return m_ShardLimit * m_ShardsCount;
+}
+
+bool SimpleTgSessionStore::Flush() {
+    if(!m_Mapping)
+        return false;
+
+#ifdef _WIN32
+    return FlushViewOfFile(m_Mapping, m_MappingSize) && FlushFileBuffers(m_FileHandle);
+#else
+    return msync(m_Mapping, m_MappingSize, MS_SYNC) == 0;
+#endif
+}
+
+bool SimpleTgSessionStore::Map(std::size_t capacity) {
+    const std::size_t shards_count = capacity >= MaxShards * 1024 ? MaxShards : 1;
+    const std::size_t shard_slots = (capacity + shards_count - 1) / shards_count * SlotsPerSession;
+    const std::size_t size = sizeof(Header) + shards_count * shard_slots * m_SlotSize;
+
+#ifdef _WIN32
+    m_FileHandle = CreateFileA(m_Path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(m_FileHandle == INVALID_HANDLE_VALUE)
+        return (m_FileHandle = nullptr), false;
+
+    LARGE_INTEGER existing_size;
+    if(!GetFileSizeEx(m_FileHandle, &existing_size))
+        return Unmap(), false;
+
+    const bool fresh = existing_size.QuadPart == 0;
+    m_MappingSize = fresh ? size : std::size_t(existing_size.QuadPart);
+
+    m_MappingHandle = CreateFileMappingA(m_FileHandle, nullptr, PAGE_READWRITE, DWORD(std::uint64_t(m_MappingSize) >> 32), DWORD(m_MappingSize), nullptr);
+    if(!m_MappingHandle)
+        return Unmap(), false;
+
+    m_Mapping = static_cast<std::uint8_t*>(MapViewOfFile(m_MappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, m_MappingSize));
+    if(!m_Mapping)
+        return Unmap(), false;
+#else
+    m_FileDescriptor = open(m_Path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(m_FileDescriptor < 0)
+        return false;
+
+    // Shard locks are per process, two processes on one table would corrupt it. Windows gets this from share mode 0
+    if(flock(m_FileDescriptor, LOCK_EX | LOCK_NB) != 0)
+        return Unmap(), false;
+
+    struct stat status;
+    if(fstat(m_FileDescriptor, &status) != 0)
+        return Unmap(), false;
+
+    const bool fresh = status.st_size == 0;
+    m_MappingSize = fresh ? size : std::size_t(status.st_size);
+
+    if(fresh && ftruncate(m_FileDescriptor, m_MappingSize) != 0)
+        return Unmap(), false;
+
+    void *mapping = mmap(nullptr, m_MappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_FileDescriptor, 0);
+    if(mapping == MAP_FAILED)
+        return Unmap(), false;
+
+    m_Mapping = static_cast<std::uint8_t*>(mapping);
+#endif
+
+    Header *header = reinterpret_cast<Header*>(m_Mapping);
+
+    if (fresh) {
+        // Mapped pages of a new file are zero-filled, so every slot starts empty
+        header->Magic = SessionStoreMagic;
+        header->Version = SessionStoreVersion;
+        header->ValueSize = std::uint32_t(m_ValueSize);
+        header->ShardSlots = shard_slots;
+        header->ShardsCount = shards_count;
+    }
+
+    const bool compatible = m_MappingSize >= sizeof(Header)
+        && header->Magic == SessionStoreMagic
+        && header->Version == SessionStoreVersion
+        && header->ValueSize == m_ValueSize
+        && header->ShardsCount && header->ShardsCount <= MaxShards
+        && header->ShardSlots >= SlotsPerSession
+        && sizeof(Header) + header->ShardsCount * header->ShardSlots * m_SlotSize <= m_MappingSize;
+
+    if(!compatible)
+        return Unmap(), false;
+
+    // Existing store keeps the capacity it was created with
+    m_ShardSlots = header->ShardSlots;
+    m_ShardLimit = m_ShardSlots / SlotsPerSession;
+    m_ShardsCount = header->ShardsCount;
+    m_Shards.reset(new Shard[m_ShardsCount]);
+
+    for (std::size_t i = 0; i < m_ShardsCount; i++)
+        m_Shards[i].Slots = m_Mapping + sizeof(Header) + i * m_ShardSlots * m_SlotSize;
+
+    m_Header = header;
+    return true;
+}
+
+void SimpleTgSessionStore::Unmap() {
+    m_Header = nullptr;
+    m_Shards.reset();
+
+#ifdef _WIN32
+    if(m_Mapping)
+        UnmapViewOfFile(m_Mapping);
+    if(m_MappingHandle)
+        CloseHandle(m_MappingHandle);
+    if(m_FileHandle)
+        CloseHandle(m_FileHandle);
+    m_MappingHandle = nullptr;
+    m_FileHandle = nullptr;
+#else
+    if(m_Mapping)
+        munmap(m_Mapping, m_MappingSize);
+    if(m_FileDescriptor >= 0)
+        close(m_FileDescriptor);
+    m_FileDescriptor = -1;
+#endif
+
+    m_Mapping = nullptr;
+}
+
+SimpleTgSessionStore::Shard& SimpleTgSessionStore::ShardOf(std::uint64_t hash) {
+    return m_Shards[(hash >> 32) % m_ShardsCount];
+}
+
+std::uint8_t* SimpleTgSessionStore::Slot(const Shard& shard, std::size_t index)const {
+    return shard.Slots + index * m_SlotSize;
+}
+
+std::uint64_t& SimpleTgSessionStore::ShardSize(const Shard& shard)const {
+    return m_Header->Sizes[&shard - m_Shards.get()];
+}
+
+std::size_t SimpleTgSessionStore::HomeIndex(std::uint64_t hash)const {
+    return (hash & 0xffffffffull) % m_ShardSlots;
+}
+
+std::uint8_t* SimpleTgSessionStore::Find(Shard& shard, std::uint64_t hash, std::int64_t chat_id, std::int64_t user_id, bool& found) {
+    found = false;
+
+    std::size_t index = HomeIndex(hash);
+
+    for (std::size_t probe = 0; probe < m_ShardSlots; probe++) {
+        std::uint8_t *slot = Slot(shard, index);
+
+        if(!SlotUsed(slot))
+            return slot;
+
+        if (SlotChat(slot) == chat_id && SlotUser(slot) == user_id) {
+            found = true;
+            return slot;
+        }
+
+        index = (index + 1) % m_ShardSlots;
+    }
+
+    return nullptr;
+}
+
+std::uint64_t SimpleTgSessionStore::Hash(std::int64_t chat_id, std::int64_t user_id) {
+    std::uint64_t x = static_cast<std::uint64_t>(chat_id) * 0x9e3779b97f4a7c15ull ^ static_cast<std::uint64_t>(user_id);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
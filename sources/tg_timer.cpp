@@ -0,0 +1,291 @@
+#include "simple/tg_timer.hpp"
+#include <algorithm>
+
+SimpleTgTimerWheel::SimpleTgTimerWheel(std::chrono::steady_clock::duration tick):
+    m_Tick(std::max<std::chrono::steady_clock::duration>(tick, std::chrono::microseconds(100)))
+{
+    m_Heads.fill(Nil);
+}
+
+SimpleTgTimerWheel::~SimpleTgTimerWheel() {
+    Stop();
+}
+
+SimpleTgTimerWheel::TimerId SimpleTgTimerWheel::ScheduleAfter(std::chrono::steady_clock::duration delay, Callback callback) {
+    return ScheduleAt(std::chrono::steady_clock::now() + delay, std::move(callback));
+}
+
+SimpleTgTimerWheel::TimerId SimpleTgTimerWheel::ScheduleAt(std::chrono::steady_clock::time_point time, Callback callback) {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    // Wheel does not tick while empty, catch up at once so Collect doesn't walk the idle period tick by tick
+    if(!m_Size)
+        m_CurrentTick = std::max(m_CurrentTick, ToTick(std::chrono::steady_clock::now()));
+
+    std::uint32_t index;
+
+    if (m_FreeNodes.size()) {
+        index = m_FreeNodes.back();
+        m_FreeNodes.pop_back();
+    } else {
+        index = static_cast<std::uint32_t>(m_Nodes.size());
+        m_Nodes.emplace_back();
+        m_Nodes.back().Generation = 1;
+    }
+
+    // Round up, a timer never fires before its time
+    const auto since_origin = time - m_Origin;
+    const std::uint64_t tick = since_origin.count() > 0 ? (since_origin + m_Tick - std::chrono::steady_clock::duration(1)) / m_Tick : 0;
+
+    Node &node = m_Nodes[index];
+    node.Function = std::move(callback);
+    node.Expiry = std::max(tick, m_CurrentTick + 1);
+
+    Insert(index);
+    m_Size++;
+
+    if(!m_Thread.joinable() && !m_Stopping)
+        m_Thread = std::thread(&SimpleTgTimerWheel::Run, this);
+
+    m_Signal.notify_one();
+
+    return (std::uint64_t(node.Generation) << 32) | index;
+}
+
+bool SimpleTgTimerWheel::Cancel(TimerId id) {
+    const std::uint32_t index = static_cast<std::uint32_t>(id);
+    const std::uint32_t generation = static_cast<std::uint32_t>(id >> 32);
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    if(index >= m_Nodes.size())
+        return false;
+
+    Node &node = m_Nodes[index];
+
+    if(node.Slot == Nil || node.Generation != generation)
+        return false;
+
+    Unlink(index);
+    Release(index);
+
+    return true;
+}
+
+std::size_t SimpleTgTimerWheel::Size() {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    return m_Size;
+}
+
+void SimpleTgTimerWheel::Advance(std::chrono::steady_clock::time_point now) {
+    std::vector<Callback> due;
+    ErrorHandler on_error;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        Collect(ToTick(now), due);
+        on_error = m_OnError;
+    }
+
+    const std::shared_ptr<std::atomic<bool>> detached = m_Detached;
+    Fire(due, on_error, detached);
+}
+
+void SimpleTgTimerWheel::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Stopping = true;
+    }
+    m_Signal.notify_all();
+
+    if(!m_Thread.joinable())
+        return;
+
+    // Thread can't join itself, wheel may be destroyed right after this returns
+    if (m_Thread.get_id() == std::this_thread::get_id()) {
+        m_Detached->store(true);
+        m_Thread.detach();
+        return;
+    }
+
+    m_Thread.join();
+}
+
+void SimpleTgTimerWheel::OnError(ErrorHandler handler) {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    m_OnError = std::move(handler);
+}
+
+std::uint64_t SimpleTgTimerWheel::ToTick(std::chrono::steady_clock::time_point time)const {
+    const auto since_origin = time - m_Origin;
+
+    return since_origin.count() > 0 ? since_origin / m_Tick : 0;
+}
+
+void SimpleTgTimerWheel::Insert(std::uint32_t index) {
+    Node &node = m_Nodes[index];
+
+    // Cascaded timer may be due this very tick, its level 0 slot is checked right after cascading
+    std::uint64_t expiry = std::max(node.Expiry, m_CurrentTick);
+    std::uint64_t delta = expiry - m_CurrentTick;
+
+    std::size_t level = 0;
+    while (level + 1 < Levels && delta >= (std::uint64_t(1) << (SlotBits * (level + 1))))
+        level++;
+
+    // Too far for the top level, park at its end, cascading will bring it closer
+    const std::uint64_t max_delta = (std::uint64_t(1) << (SlotBits * Levels)) - 1;
+    if (delta > max_delta)
+        expiry = m_CurrentTick + max_delta;
+
+    const std::uint32_t slot = static_cast<std::uint32_t>(level * Slots + ((expiry >> (SlotBits * level)) & (Slots - 1)));
+
+    node.Slot = slot;
+    node.Prev = Nil;
+    node.Next = m_Heads[slot];
+
+    if(node.Next != Nil)
+        m_Nodes[node.Next].Prev = index;
+
+    m_Heads[slot] = index;
+    m_LevelSizes[level]++;
+}
+
+void SimpleTgTimerWheel::Unlink(std::uint32_t index) {
+    Node &node = m_Nodes[index];
+
+    if(node.Prev != Nil)
+        m_Nodes[node.Prev].Next = node.Next;
+    else
+        m_Heads[node.Slot] = node.Next;
+
+    if(node.Next != Nil)
+        m_Nodes[node.Next].Prev = node.Prev;
+
+    m_LevelSizes[node.Slot / Slots]--;
+
+    node.Slot = Nil;
+    node.Prev = Nil;
+    node.Next = Nil;
+}
+
+void SimpleTgTimerWheel::Release(std::uint32_t index) {
+    Node &node = m_Nodes[index];
+
+    node.Function = nullptr;
+    node.Generation++;
+
+    m_FreeNodes.push_back(index);
+    m_Size--;
+}
+
+void SimpleTgTimerWheel::Collect(std::uint64_t tick, std::vector<Callback>& due) {
+    while (m_CurrentTick < tick) {
+        if (!m_Size) {
+            m_CurrentTick = tick;
+            break;
+        }
+
+        // Nothing can happen before the next cascade of the lowest non-empty level, skip to it
+        std::size_t empty_levels = 0;
+        while(empty_levels < Levels && !m_LevelSizes[empty_levels])
+            empty_levels++;
+
+        if (empty_levels) {
+            const std::size_t bits = SlotBits * empty_levels;
+            const std::uint64_t cascade = ((m_CurrentTick >> bits) + 1) << bits;
+
+            m_CurrentTick = std::max(m_CurrentTick, std::min(tick, cascade) - 1);
+        }
+
+        m_CurrentTick++;
+
+        for (std::size_t level = 1; level < Levels; level++) {
+            if(m_CurrentTick & ((std::uint64_t(1) << (SlotBits * level)) - 1))
+                break;
+
+            const std::uint32_t slot = static_cast<std::uint32_t>(level * Slots + ((m_CurrentTick >> (SlotBits * level)) & (Slots - 1)));
+
+            for (std::uint32_t index = m_Heads[slot]; index != Nil;) {
+                std::uint32_t next = m_Nodes[index].Next;
+
+                Unlink(index);
+                Insert(index);
+
+                index = next;
+            }
+        }
+
+        const std::uint32_t slot = static_cast<std::uint32_t>(m_CurrentTick & (Slots - 1));
+
+        for (std::uint32_t index = m_Heads[slot]; index != Nil;) {
+            std::uint32_t next = m_Nodes[index].Next;
+
+            Unlink(index);
+
+            if (m_Nodes[index].Expiry <= m_CurrentTick) {
+                due.push_back(std::move(m_Nodes[index].Function));
+                Release(index);
+            } else {
+                Insert(index);
+            }
+
+            index = next;
+        }
+    }
+}
+
+void SimpleTgTimerWheel::Run() {
+    std::unique_lock<std::mutex> lock(m_Lock);
+
+    const std::shared_ptr<std::atomic<bool>> detached = m_Detached;
+
+    while (!m_Stopping) {
+        if (!m_Size) {
+            m_Signal.wait(lock);
+            continue;
+        }
+
+        // With the bottom level empty nothing can fire before the next cascade
+        const std::uint64_t next = m_LevelSizes[0] ? m_CurrentTick + 1 : ((m_CurrentTick >> SlotBits) + 1) << SlotBits;
+
+        m_Signal.wait_until(lock, m_Origin + m_Tick * next);
+
+        if(m_Stopping)
+            break;
+
+        std::vector<Callback> due;
+        Collect(ToTick(std::chrono::steady_clock::now()), due);
+
+        if(!due.size())
+            continue;
+
+        ErrorHandler on_error = m_OnError;
+        lock.unlock();
+
+        if(!Fire(due, on_error, detached))
+            return;
+
+        lock.lock();
+    }
+}
+
+bool SimpleTgTimerWheel::Fire(std::vector<Callback>& due, const ErrorHandler& on_error, const std::shared_ptr<std::atomic<bool>>& detached) {
+    for (const auto &callback : due) {
+        try {
+            callback();
+        } catch (const std::exception &e) {
+            if(on_error)
+                on_error(e.what());
+        } catch (...) {
+            if(on_error)
+                on_error("Unknown exception");
+        }
+
+        if(detached->load())
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,208 @@
+#include "simple/tg_trace.hpp"
+#include "simple/tg_metrics.hpp"
+#include <atomic>
+#include <fstream>
+#include <boost/json.hpp>
+
+static std::uint32_t CurrentThreadId() {
+    static std::atomic<std::uint32_t> s_NextThreadId{1};
+    static thread_local std::uint32_t s_ThreadId = s_NextThreadId++;
+
+    return s_ThreadId;
+}
+
+SimpleTgTracer::Span::Span(SimpleTgTracer* tracer, std::string_view name, const char* category, std::int64_t chat_id):
+    m_Tracer(tracer)
+{
+    if(!m_Tracer)
+        return;
+
+    m_Span.Name = name;
+    m_Span.Category = category;
+    m_Span.ChatId = chat_id;
+    m_Span.ThreadId = CurrentThreadId();
+    m_Span.Start = m_Tracer->Now();
+}
+
+SimpleTgTracer::Span::~Span() {
+    if(!m_Tracer)
+        return;
+
+    m_Span.Duration = m_Tracer->Now() - m_Span.Start;
+    m_Tracer->Add(std::move(m_Span));
+}
+
+SimpleTgTracer::HandlerScope::HandlerScope(SimpleTgTracer* tracer, std::string_view name, std::int64_t chat_id):
+    m_Tracer(tracer),
+    m_Id(tracer ? tracer->BeginHandler(name, chat_id) : 0),
+    m_Span(tracer, name, "handler", chat_id)
+{}
+
+SimpleTgTracer::HandlerScope::~HandlerScope() {
+    if(m_Tracer)
+        m_Tracer->EndHandler(m_Id);
+}
+
+SimpleTgTracer::SimpleTgTracer(std::size_t capacity):
+    m_Spans(capacity ? capacity : 1)
+{}
+
+SimpleTgTracer::~SimpleTgTracer() {
+    StopWatchdog();
+}
+
+void SimpleTgTracer::Add(TraceSpan span) {
+    std::lock_guard<std::mutex> lock(m_SpansLock);
+
+    m_Spans[m_NextSpan] = std::move(span);
+    m_NextSpan++;
+
+    if (m_NextSpan == m_Spans.size()) {
+        m_NextSpan = 0;
+        m_Wrapped = true;
+    }
+}
+
+std::vector<TraceSpan> SimpleTgTracer::Spans()const {
+    std::lock_guard<std::mutex> lock(m_SpansLock);
+
+    std::vector<TraceSpan> spans;
+
+    if (m_Wrapped)
+        spans.insert(spans.end(), m_Spans.begin() + m_NextSpan, m_Spans.end());
+    spans.insert(spans.end(), m_Spans.begin(), m_Spans.begin() + m_NextSpan);
+
+    return spans;
+}
+
+void SimpleTgTracer::Clear() {
+    std::lock_guard<std::mutex> lock(m_SpansLock);
+
+    m_NextSpan = 0;
+    m_Wrapped = false;
+}
+
+std::string SimpleTgTracer::ToChromeTrace()const {
+    boost::json::array events;
+
+    for (const TraceSpan &span : Spans()) {
+        boost::json::object event;
+        event["name"] = span.Name;
+        event["cat"] = span.Category;
+        event["ph"] = "X";
+        event["ts"] = span.Start;
+        event["dur"] = span.Duration;
+        event["pid"] = 1;
+        event["tid"] = span.ThreadId;
+
+        if(span.ChatId)
+            event["args"] = boost::json::object{{"chat_id", span.ChatId}};
+
+        events.push_back(std::move(event));
+    }
+
+    return boost::json::serialize(boost::json::object{{"traceEvents", std::move(events)}, {"displayTimeUnit", "ms"}});
+}
+
+bool SimpleTgTracer::WriteChromeTrace(const std::string& path)const {
+    std::ofstream file(path, std::ios::binary);
+
+    if(!file)
+        return false;
+
+    file << ToChromeTrace();
+
+    return (bool)file;
+}
+
+void SimpleTgTracer::StartWatchdog(std::chrono::steady_clock::duration budget, SlowHandlerCallback callback) {
+    StopWatchdog();
+
+    {
+        std::lock_guard<std::mutex> lock(m_HandlersLock);
+        m_Budget = budget;
+        m_OnSlowHandler = std::move(callback);
+        m_WatchdogRunning = true;
+    }
+
+    m_Watchdog = std::thread(&SimpleTgTracer::WatchdogLoop, this);
+}
+
+void SimpleTgTracer::StopWatchdog() {
+    {
+        std::lock_guard<std::mutex> lock(m_HandlersLock);
+        m_WatchdogRunning = false;
+    }
+    m_WatchdogSignal.notify_all();
+
+    if(m_Watchdog.joinable())
+        m_Watchdog.join();
+}
+
+std::int64_t SimpleTgTracer::Now()const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_Origin).count();
+}
+
+std::uint64_t SimpleTgTracer::BeginHandler(std::string_view name, std::int64_t chat_id) {
+    std::lock_guard<std::mutex> lock(m_HandlersLock);
+
+    std::uint64_t id = m_NextHandlerId++;
+    m_RunningHandlers.emplace(id, RunningHandler{std::string(name), chat_id, std::chrono::steady_clock::now()});
+
+    return id;
+}
+
+void SimpleTgTracer::EndHandler(std::uint64_t id) {
+    std::lock_guard<std::mutex> lock(m_HandlersLock);
+
+    m_RunningHandlers.erase(id);
+}
+
+void SimpleTgTracer::WatchdogLoop() {
+    std::unique_lock<std::mutex> lock(m_HandlersLock);
+
+    const auto period = std::max<std::chrono::steady_clock::duration>(m_Budget / 4, std::chrono::milliseconds(10));
+
+    while (m_WatchdogRunning) {
+        m_WatchdogSignal.wait_for(lock, period);
+
+        const auto now = std::chrono::steady_clock::now();
+
+        std::vector<SlowHandler> slow;
+
+        for (auto &[id, handler] : m_RunningHandlers) {
+            if(handler.Reported || now - handler.Start < m_Budget)
+                continue;
+
+            handler.Reported = true;
+            slow.push_back({handler.Name, handler.ChatId, now - handler.Start});
+        }
+
+        if(!slow.size() || !m_OnSlowHandler)
+            continue;
+
+        // Callback may log through the network, don't hold handlers hostage meanwhile
+        SlowHandlerCallback callback = m_OnSlowHandler;
+        lock.unlock();
+
+        for (const auto &handler : slow)
+            callback(handler);
+
+        lock.lock();
+    }
+}
+
+SimpleTgTracingHttpClient::SimpleTgTracingHttpClient(SimpleTgTracer& tracer, const TgBot::HttpClient& client):
+    m_Client(client),
+    m_Tracer(tracer)
+{
+    _timeout = m_Client._timeout;
+}
+
+std::string SimpleTgTracingHttpClient::makeRequest(const TgBot::Url& url, const std::vector<TgBot::HttpReqArg>& args) const {
+    const_cast<TgBot::HttpClient&>(m_Client)._timeout = _timeout;
+
+    SimpleTgTracer::Span span(&m_Tracer, SimpleTgMetricsHttpClient::GetMethodName(url.path), "outbound");
+
+    return m_Client.makeRequest(url, args);
+}
@@ -0,0 +1,291 @@
+#include "simple/tg_upload_cache.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+SimpleTgUploadCache::SimpleTgUploadCache(std::string path, std::size_t capacity, std::size_t batch_size):
+    m_Path(std::move(path)),
+    m_Capacity(capacity ? capacity : 1),
+    m_BatchSize(batch_size ? batch_size : 1)
+{
+    if(!m_Path.size())
+        return;
+
+    std::ifstream file(m_Path);
+    std::string hash;
+    std::string file_id;
+
+    // Stored most recent first, appending keeps the order
+    while (file >> hash >> file_id && m_Entries.size() < m_Capacity) {
+        std::uint64_t key = 0;
+
+        try {
+            key = std::stoull(hash, nullptr, 16);
+        } catch (const std::exception&) {
+            continue;
+        }
+
+        if(m_Index.count(key))
+            continue;
+
+        m_Entries.emplace_back(key, std::move(file_id));
+        m_Index.emplace(key, std::prev(m_Entries.end()));
+    }
+
+    m_Writer = std::thread(&SimpleTgUploadCache::RunWriter, this);
+}
+
+SimpleTgUploadCache::~SimpleTgUploadCache() {
+    if (m_Writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            m_Stopping = true;
+        }
+        m_WriteRequested.notify_one();
+        m_Writer.join();
+    }
+
+    Flush();
+}
+
+std::optional<std::string> SimpleTgUploadCache::Find(std::uint64_t hash) {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    auto it = m_Index.find(hash);
+
+    if(it == m_Index.end())
+        return std::nullopt;
+
+    m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+
+    return it->second->second;
+}
+
+void SimpleTgUploadCache::Insert(std::uint64_t hash, std::string file_id) {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    Touch(hash, std::move(file_id));
+
+    if(++m_PendingWrites >= m_BatchSize)
+        m_WriteRequested.notify_one();
+}
+
+void SimpleTgUploadCache::Erase(std::uint64_t hash) {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    auto it = m_Index.find(hash);
+
+    if(it == m_Index.end())
+        return;
+
+    m_Entries.erase(it->second);
+    m_Index.erase(it);
+    m_PendingWrites++;
+}
+
+std::size_t SimpleTgUploadCache::Size()const {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    return m_Entries.size();
+}
+
+bool SimpleTgUploadCache::Flush() {
+    return Write();
+}
+
+void SimpleTgUploadCache::Touch(std::uint64_t hash, std::string file_id) {
+    auto it = m_Index.find(hash);
+
+    if (it != m_Index.end()) {
+        it->second->second = std::move(file_id);
+        m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+        return;
+    }
+
+    m_Entries.emplace_front(hash, std::move(file_id));
+    m_Index.emplace(hash, m_Entries.begin());
+
+    if (m_Entries.size() > m_Capacity) {
+        m_Index.erase(m_Entries.back().first);
+        m_Entries.pop_back();
+    }
+}
+
+void SimpleTgUploadCache::RunWriter() {
+    std::unique_lock<std::mutex> lock(m_Lock);
+
+    while (!m_Stopping) {
+        m_WriteRequested.wait(lock, [this] { return m_Stopping || m_PendingWrites >= m_BatchSize; });
+
+        if(m_Stopping)
+            break;
+
+        lock.unlock();
+        const bool written = Write();
+        lock.lock();
+
+        // Don't spin on a full or read-only disk, inserts keep piling up in memory meanwhile
+        if(!written)
+            m_WriteRequested.wait_for(lock, std::chrono::seconds(5), [this] { return m_Stopping; });
+    }
+}
+
+bool SimpleTgUploadCache::Write() {
+    std::lock_guard<std::mutex> write_lock(m_WriteLock);
+
+    std::vector<Entry> entries;
+    std::size_t pending = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+
+        if(!m_PendingWrites)
+            return true;
+
+        pending = std::exchange(m_PendingWrites, 0);
+
+        if(m_Path.size())
+            entries.assign(m_Entries.begin(), m_Entries.end());
+    }
+
+    if(!m_Path.size() || WriteFile(entries))
+        return true;
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_PendingWrites += pending;
+    return false;
+}
+
+bool SimpleTgUploadCache::WriteFile(const std::vector<Entry>& entries)const {
+    const std::string temporary = m_Path + ".tmp";
+
+    std::ostringstream content;
+    char hash[17];
+
+    for (const auto &[key, file_id] : entries) {
+        std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(key));
+        content << hash << ' ' << file_id << '\n';
+    }
+
+    const std::string data = content.str();
+
+    std::FILE *file = std::fopen(temporary.c_str(), "wb");
+
+    if(!file)
+        return false;
+
+    bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size() && std::fflush(file) == 0;
+
+    // Synced before the rename, a crash must not replace a good cache with a truncated one
+#ifdef _WIN32
+    written = written && _commit(_fileno(file)) == 0;
+#else
+    written = written && fsync(fileno(file)) == 0;
+#endif
+
+    if(std::fclose(file) != 0 || !written)
+        return false;
+
+    std::error_code error;
+    std::filesystem::rename(temporary, m_Path, error);
+
+    return !error;
+}
+
+static constexpr std::uint64_t Prime1 = 11400714785074694791ull;
+static constexpr std::uint64_t Prime2 = 14029467366897019727ull;
+static constexpr std::uint64_t Prime3 = 1609587929392839161ull;
+static constexpr std::uint64_t Prime4 = 9650029242287828579ull;
+static constexpr std::uint64_t Prime5 = 2870177450012600261ull;
+
+static std::uint64_t RotateLeft(std::uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static std::uint64_t Read64(const char *data) {
+    std::uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static std::uint32_t Read32(const char *data) {
+    std::uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static std::uint64_t HashRound(std::uint64_t accumulator, std::uint64_t input) {
+    accumulator += input * Prime2;
+    accumulator = RotateLeft(accumulator, 31);
+    return accumulator * Prime1;
+}
+
+static std::uint64_t HashMerge(std::uint64_t accumulator, std::uint64_t value) {
+    accumulator ^= HashRound(0, value);
+    return accumulator * Prime1 + Prime4;
+}
+
+std::uint64_t SimpleTgUploadCache::Hash(std::string_view data, std::uint64_t seed) {
+    const char *it = data.data();
+    const char *end = it + data.size();
+
+    std::uint64_t hash;
+
+    if (data.size() >= 32) {
+        std::uint64_t v1 = seed + Prime1 + Prime2;
+        std::uint64_t v2 = seed + Prime2;
+        std::uint64_t v3 = seed;
+        std::uint64_t v4 = seed - Prime1;
+
+        for (; it + 32 <= end; it += 32) {
+            v1 = HashRound(v1, Read64(it));
+            v2 = HashRound(v2, Read64(it + 8));
+            v3 = HashRound(v3, Read64(it + 16));
+            v4 = HashRound(v4, Read64(it + 24));
+        }
+
+        hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+        hash = HashMerge(hash, v1);
+        hash = HashMerge(hash, v2);
+        hash = HashMerge(hash, v3);
+        hash = HashMerge(hash, v4);
+    } else {
+        hash = seed + Prime5;
+    }
+
+    hash += data.size();
+
+    for (; it + 8 <= end; it += 8) {
+        hash ^= HashRound(0, Read64(it));
+        hash = RotateLeft(hash, 27) * Prime1 + Prime4;
+    }
+
+    if (it + 4 <= end) {
+        hash ^= Read32(it) * Prime1;
+        hash = RotateLeft(hash, 23) * Prime2 + Prime3;
+        it += 4;
+    }
+
+    for (; it < end; it++) {
+        hash ^= static_cast<std::uint8_t>(*it) * Prime5;
+        hash = RotateLeft(hash, 11) * Prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+
+    return hash;
+}